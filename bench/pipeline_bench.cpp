@@ -0,0 +1,84 @@
+// Commands per second through startJob(), for a mixed pipeline workload
+// run three ways:
+//   direct     - as typed: parsePipeline() execs every stage itself
+//   bash/stage - each stage wrapped in its own `bash -c` (the old launcher)
+//   bash/line  - the whole line in one `bash -c` (the parser's fallback)
+// usage: bench/pipeline_bench [commands]    (make bench)
+#include "../execute.cpp"
+
+static const vector<string> workload = {
+    "ls -l /usr/bin | wc -l",
+    "seq 200 | sort -r | head -3",
+    "cat /etc/passwd | grep root | cut -d: -f1",
+    "echo hello",
+    "ps -e | wc -l",
+};
+
+static string quoted(const string &s)
+{
+    string q = "'";
+    for (char c : s)
+        q += c == '\'' ? string("'\\''") : string(1, c);
+    return q + "'";
+}
+
+static string perStage(const string &cmd)
+{
+    string out;
+    size_t from = 0;
+    while (from <= cmd.size())
+    {
+        size_t bar = cmd.find('|', from);
+        if (bar == string::npos)
+            bar = cmd.size();
+        if (!out.empty())
+            out += " | ";
+        out += "bash -c " + quoted(trimBlanks(cmd.substr(from, bar - from)));
+        from = bar + 1;
+    }
+    return out;
+}
+
+static void runOne(const string &cmd)
+{
+    TabState T;
+    T.cwd = "/tmp";
+    vector<string> out;
+    if (!startJob(cmd, T, out))
+        return;
+    while (T.job)
+    {
+        vector<pollfd> p;
+        for (int fd : {T.job->outFd, T.job->errFd})
+            if (fd >= 0)
+                p.push_back({fd, POLLIN, 0});
+        if (p.empty())
+        {
+            waitpid(T.job->pids.front(), nullptr, 0);
+            reapJob(T);
+            continue;
+        }
+        poll(p.data(), p.size(), -1);
+        for (auto &x : p)
+            if (x.revents && T.job)
+                pumpJob(T, x.fd);
+    }
+}
+
+static double commandsPerSecond(int count, string (*wrap)(const string &))
+{
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+        runOne(wrap(workload[i % workload.size()]));
+    return count / chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 300;
+    printf("%d commands, round robin over %zu pipelines\n", count, workload.size());
+    printf("  direct     %6.0f cmd/s\n", commandsPerSecond(count, [](const string &c) { return c; }));
+    printf("  bash/stage %6.0f cmd/s\n", commandsPerSecond(count, perStage));
+    printf("  bash/line  %6.0f cmd/s\n", commandsPerSecond(count, [](const string &c) { return "bash -c " + quoted(c); }));
+    return 0;
+}
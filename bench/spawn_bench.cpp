@@ -0,0 +1,73 @@
+// Launch latency against parent RSS: fork+exec vs spawnProcess().
+// Grows the heap to each size, touches every page, then times starting
+// and waiting for /bin/true both ways.
+// usage: bench/spawn_bench [runs] [MB ...]    (make bench)
+#include "../helper/spawn.cpp"
+#include <sys/mman.h>
+
+static double forkExecUs()
+{
+    auto t0 = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execl("/bin/true", "true", (char *)nullptr);
+        _exit(127);
+    }
+    waitpid(pid, nullptr, 0);
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+}
+
+static double spawnUs()
+{
+    SpawnSpec spec;
+    spec.argv = {"/bin/true"};
+    auto t0 = chrono::steady_clock::now();
+    pid_t pid = spawnProcess(spec);
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+}
+
+static double median(vector<double> v)
+{
+    sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 20;
+    vector<size_t> sizes;
+    for (int i = 2; i < argc; ++i)
+        sizes.push_back((size_t)atol(argv[i]));
+    if (sizes.empty())
+        sizes = {0, 256, 1024, 2048};
+
+    // one mapping grown in place, so each size includes the previous ones
+    vector<char *> blocks;
+    size_t have = 0;
+    printf("%8s  %14s  %14s   (median of %d)\n", "RSS MB", "fork+exec us", "posix_spawn us", runs);
+    for (size_t mb : sizes)
+    {
+        if (mb > have)
+        {
+            size_t len = (mb - have) << 20;
+            char *p = (char *)mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                err(1, "mmap %zu MB", mb);
+            for (size_t off = 0; off < len; off += 4096)
+                p[off] = 1;
+            blocks.push_back(p);
+            have = mb;
+        }
+        vector<double> forked, spawned;
+        for (int r = 0; r < runs; ++r)
+        {
+            forked.push_back(forkExecUs());
+            spawned.push_back(spawnUs());
+        }
+        printf("%8zu  %14.0f  %14.0f\n", have, median(forked), median(spawned));
+    }
+    return 0;
+}
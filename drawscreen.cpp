@@ -40,6 +40,27 @@ static const int TAB_PADDING = 8;
 static const int TAB_SPACING = 4;
 int hovered_tab_index = -1;
 
+// one soft-wrapped display row: a slice of a screenBuffer line
+struct WrapRow
+{
+    int line;  // index into screenBuffer
+    int start; // byte offset of the slice
+    int len;
+};
+
+// one painted content row, remembered for damage tracking
+struct ShownRow
+{
+    string text;
+    int promptChars = 0;
+    bool changed = false; // multiWatch line that differs from the previous run
+};
+
+struct Job;      // running command, see execute.cpp
+struct PtyShell; // long-lived per-tab shell, see execute.cpp
+struct WatchSession; // multiWatch run, see execute.cpp
+struct WatchFrame;   // one published multiWatch screen, see execute.cpp
+
 struct TabState
 {
     // UI buffers / state
@@ -48,9 +69,11 @@ struct TabState
     string input;
     int currCursorPos = 0;
     bool isSearching = false;
+    bool searchPreview = false; // Ctrl+R: best match shown above the search line
     bool inRec = false;
     string showRec = "";
     vector<string> recs;
+    shared_ptr<CompletionScan> completion; // Tab: directory still being read
     string query = "";
     string forRec = "";
     int inpIdx = 0;
@@ -58,76 +81,117 @@ struct TabState
     bool userScrolled = false;
     bool isMultLine = false;
     int count = 0;
-    // cursor blink
+    // cursor blink (toggled by the blink timer in run())
     bool showCursor = true;
-    chrono::steady_clock::time_point lastBlink = chrono::steady_clock::now();
     // per-tab cwd
     string cwd = "/";
     // title
     string title;
-    
+    // command still running in this tab, output streams in as it arrives
+    shared_ptr<Job> job;
+    // set by "pty on": commands go to this shell instead of fresh processes
+    shared_ptr<PtyShell> shell;
+    // multiWatch running here: screenBuffer shows its latest snapshot
+    shared_ptr<WatchSession> watch;
+    shared_ptr<const WatchFrame> watchShown; // frame now in screenBuffer
+    vector<string> watchSaved;               // screen to restore when it stops
+    vector<char> lineMarks;                  // per screenBuffer line: changed in its last run
+    // soft-wrap cache, rebuilt incrementally by updateWrapCache()
+    vector<WrapRow> wrapRows;
+    vector<int> wrapLineStart; // first wrapRows index of each cached line
+    int wrapWidth = -1;        // content width the cache was built for
+    size_t wrapValid = 0;      // leading screenBuffer lines whose rows are current
+    // damage tracking: what drawScreen last painted for this tab
+    vector<ShownRow> shownRows;
+    int shownCursorRow = -1; // visible row holding the cursor, -1 if off screen
+    int shownCursorX = 0;
+    bool shownCursorOn = false;
+    bool fullDamage = true; // repaint the whole content area on the next draw
 };
 
-static const int SCROLL_STEP = 3; // lines per wheel/page step
-
-// Globals shared across tabs
-vector<string> inputs; // history (shared)
-
-// draw one tab content (adapted from your drawScreen; clears only content area)
-static int drawScreen(Window win, GC gc, XFontStruct *font,
-                      TabState &T)
+// advance widths of the loaded font, filled once by loadGlyphAdvances()
+struct GlyphAdvances
 {
-    // window metrics
-    XWindowAttributes attrs;
-    XGetWindowAttributes(dpy, win, &attrs);
-    int winWidth = attrs.width;
-    int winHeight = attrs.height;
-
-    // Clear only content area (below navbar)
-    XClearArea(dpy, win, 0, NAVBAR_H, winWidth, winHeight - NAVBAR_H, False);
-
-    int lineHeight = font->ascent + font->descent;
-
-    // margins inside content
-    int marginLeft = 10;
-    int marginTop = NAVBAR_H + 30;
+    int width[256] = {};
+    bool monospace = false;
+    int cell = 0; // advance shared by every glyph when monospace
+};
+static GlyphAdvances glyphs;
 
-    // allocate colors once
-    static bool colorsInit = false;
-    static unsigned long greenPixel = WhitePixel(dpy, scr);
-    static unsigned long whitePixel = WhitePixel(dpy, scr);
-    static unsigned long redPixel = WhitePixel(dpy, scr);
-    if (!colorsInit)
+// XTextWidth is pure client-side math on the XFontStruct, so asking it once
+// per byte value gives the exact same widths it would return later.
+static void loadGlyphAdvances(XFontStruct *font)
+{
+    for (int c = 0; c < 256; ++c)
     {
-        Colormap colormap = DefaultColormap(dpy, scr);
-        XColor green, white, red, exact;
+        char ch = (char)c;
+        glyphs.width[c] = XTextWidth(font, &ch, 1);
+    }
+    glyphs.cell = glyphs.width[(unsigned char)' '];
+    glyphs.monospace = glyphs.cell > 0;
+    for (int c = 0; c < 256 && glyphs.monospace; ++c)
+        if (glyphs.width[c] != glyphs.cell)
+            glyphs.monospace = false;
+}
 
-        if (XAllocNamedColor(dpy, colormap, "green", &green, &exact))
-            greenPixel = green.pixel;
+static int textWidth(const char *s, size_t n)
+{
+    if (glyphs.monospace)
+        return (int)n * glyphs.cell;
+    int w = 0;
+    for (size_t i = 0; i < n; ++i)
+        w += glyphs.width[(unsigned char)s[i]];
+    return w;
+}
 
-        if (XAllocNamedColor(dpy, colormap, "white", &white, &exact))
-            whitePixel = white.pixel;
+static int textWidth(const string &s)
+{
+    return textWidth(s.data(), s.size());
+}
 
-        if (XAllocNamedColor(dpy, colormap, "red", &red, &exact))
-            redPixel = red.pixel;
+// Mark screenBuffer lines from `fromLine` on as changed. Needed whenever lines
+// are replaced or removed; plain push_back and edits of the last line are
+// picked up automatically.
+static void invalidateWrap(TabState &T, size_t fromLine = 0)
+{
+    T.wrapValid = min(T.wrapValid, fromLine);
+}
 
-        colorsInit = true;
+// Bring the wrap cache up to date: only lines added or invalidated since the
+// last call are wrapped again, unless the content width changed.
+static void updateWrapCache(TabState &T, int maxWidth)
+{
+    if (maxWidth != T.wrapWidth)
+    {
+        T.wrapWidth = maxWidth;
+        T.wrapValid = 0;
     }
 
-    const string promptPrefix = "swagnik@myterm:";
-
-    struct DisplayLine
+    // the last line is the live one (prompt / typed input), always rewrap it
+    size_t n = T.screenBuffer.size();
+    T.wrapValid = min(T.wrapValid, n > 0 ? n - 1 : 0);
+    if (T.wrapValid < T.wrapLineStart.size())
     {
-        string text;
-        int promptChars;
-    };
-    vector<DisplayLine> displayLines;
+        T.wrapRows.resize(T.wrapLineStart[T.wrapValid]);
+        T.wrapLineStart.resize(T.wrapValid);
+    }
 
-    for (const auto &origLine : T.screenBuffer)
+    for (size_t i = T.wrapValid; i < n; ++i)
     {
+        const string &origLine = T.screenBuffer[i];
+        T.wrapLineStart.push_back((int)T.wrapRows.size());
         if (origLine.empty())
         {
-            displayLines.push_back({"", 0});
+            T.wrapRows.push_back({(int)i, 0, 0});
+            continue;
+        }
+
+        if (glyphs.monospace)
+        {
+            // fixed cells: every row but the last holds exactly perRow bytes
+            size_t perRow = (size_t)max(1, maxWidth / glyphs.cell);
+            for (size_t pos = 0; pos < origLine.size(); pos += perRow)
+                T.wrapRows.push_back({(int)i, (int)pos, (int)min(perRow, origLine.size() - pos)});
             continue;
         }
 
@@ -140,9 +204,8 @@ static int drawScreen(Window win, GC gc, XFontStruct *font,
 
             for (; pos < origLine.size(); ++pos)
             {
-                char c = origLine[pos];
-                int cw = XTextWidth(font, &c, 1);
-                if (curWidth + cw > winWidth - marginLeft - 10)
+                int cw = glyphs.width[(unsigned char)origLine[pos]];
+                if (curWidth + cw > maxWidth)
                     break;
                 curWidth += cw;
                 ++len;
@@ -154,18 +217,178 @@ static int drawScreen(Window win, GC gc, XFontStruct *font,
                 ++len;
             }
 
-            string piece = origLine.substr(start, len);
-            int promptCharsInPiece = 0;
-            if (start == 0 && origLine.rfind(promptPrefix, 0) == 0)
-                promptCharsInPiece = (int)min<size_t>(len, promptPrefix.size());
+            T.wrapRows.push_back({(int)i, (int)start, (int)len});
+        }
+    }
+    T.wrapValid = n;
+}
+
+// margins inside content
+static const int MARGIN_LEFT = 10;
+static const int MARGIN_TOP = NAVBAR_H + 30; // baseline of the first row
+
+// Window geometry and the metrics derived from it. Updated only from
+// ConfigureNotify, so draw and hit-test paths never ask the server.
+struct WindowState
+{
+    int width = WIDTH;
+    int height = HEIGHT;
+    int lineHeight = 1;  // font ascent + descent
+    int visibleRows = 1; // content rows that fit below the navbar
+};
+static WindowState win_state;
+
+static void set_geometry(int w, int h)
+{
+    win_state.width = w;
+    win_state.height = h;
+    win_state.visibleRows = max(1, (h - MARGIN_TOP) / win_state.lineHeight);
+}
+
+// Off-screen back buffer. Everything is drawn into it and then shown with a
+// single XCopyArea, so the window never displays a half-painted frame.
+static Pixmap backbuf = None;
+static int backbuf_w = 0, backbuf_h = 0;
+static bool backbuf_ready = false; // holds a complete frame
+static bool frame_open = false;    // inside draw_frame(): defer presenting
+static unsigned long bg_pixel = 0; // window background, set by create_window
+
+// (re)create the back buffer when the window size changes
+static void resize_backbuffer(Window win, int w, int h)
+{
+    if (backbuf != None && w == backbuf_w && h == backbuf_h)
+        return;
+    if (backbuf != None)
+        XFreePixmap(dpy, backbuf);
+    backbuf = XCreatePixmap(dpy, win, max(1, w), max(1, h), DefaultDepth(dpy, scr));
+    backbuf_w = w;
+    backbuf_h = h;
+    backbuf_ready = false;
+}
+
+static Drawable canvas(Window win)
+{
+    return backbuf != None ? backbuf : win;
+}
+
+// copy a finished area of the back buffer to the window
+static void present(Window win, GC gc, int x, int y, int w, int h)
+{
+    if (backbuf == None || frame_open)
+        return;
+    XCopyArea(dpy, backbuf, win, gc, x, y, w, h, x, y);
+    // build with -DMYTERM_FRAME_STATS to log the X requests behind every
+    // presented frame; drawing makes no synchronous calls, so requests are
+    // the whole cost
+#ifdef MYTERM_FRAME_STATS
+    static unsigned long lastReq = 0;
+    unsigned long req = XNextRequest(dpy);
+    fprintf(stderr, "frame: %lu requests\n", req - lastReq);
+    lastReq = req;
+#endif
+}
+
+static const int SCROLL_STEP = 3; // lines per wheel/page step
+
+// Globals shared across tabs
+vector<string_view> inputs; // history (views into the history store, shared)
+
+// colors used for tab content, allocated once
+static unsigned long greenPixel, whitePixel, redPixel, changedPixel;
+static void init_colors()
+{
+    static bool colorsInit = false;
+    if (colorsInit)
+        return;
+    greenPixel = whitePixel = redPixel = WhitePixel(dpy, scr);
+    changedPixel = bg_pixel;
+
+    Colormap colormap = DefaultColormap(dpy, scr);
+    XColor green, white, red, changed, exact;
+
+    if (XAllocNamedColor(dpy, colormap, "green", &green, &exact))
+        greenPixel = green.pixel;
+
+    if (XAllocNamedColor(dpy, colormap, "white", &white, &exact))
+        whitePixel = white.pixel;
+
+    if (XAllocNamedColor(dpy, colormap, "red", &red, &exact))
+        redPixel = red.pixel;
 
-            displayLines.push_back({piece, promptCharsInPiece});
+    if (XAllocNamedColor(dpy, colormap, "#4A4A10", &changed, &exact))
+        changedPixel = changed.pixel;
+
+    colorsInit = true;
+}
+
+// Paint visible row `i` of the content area from scratch: background band,
+// text and, if `cursorX` >= 0, the cursor bar.
+static void paint_row(Drawable d, GC gc, XFontStruct *font, int winWidth,
+                      int i, const ShownRow &r, int cursorX)
+{
+    int lineHeight = win_state.lineHeight;
+    int y = MARGIN_TOP + i * lineHeight;
+    int x = MARGIN_LEFT;
+
+    XSetForeground(dpy, gc, r.changed ? changedPixel : bg_pixel);
+    XFillRectangle(dpy, d, gc, 0, y - font->ascent, winWidth, lineHeight);
+
+    unsigned long color = whitePixel;
+    string textToDraw = r.text;
+
+    if (textToDraw.rfind("ERROR:", 0) == 0)
+    {
+        color = redPixel;
+        textToDraw = textToDraw.substr(7);
+    }
+
+    if (r.promptChars > 0)
+    {
+        string ppart = textToDraw.substr(0, r.promptChars);
+        XSetForeground(dpy, gc, greenPixel);
+        XDrawString(dpy, d, gc, x, y, ppart.c_str(), (int)ppart.length());
+        x += textWidth(ppart);
+
+        string rpart = textToDraw.substr(r.promptChars);
+        if (!rpart.empty())
+        {
+            XSetForeground(dpy, gc, color);
+            XDrawString(dpy, d, gc, x, y, rpart.c_str(), (int)rpart.length());
         }
     }
+    else if (!textToDraw.empty())
+    {
+        XSetForeground(dpy, gc, color);
+        XDrawString(dpy, d, gc, x, y, textToDraw.c_str(), (int)textToDraw.length());
+    }
+
+    if (cursorX >= 0)
+    {
+        XSetForeground(dpy, gc, WhitePixel(dpy, scr));
+        XDrawLine(dpy, d, gc, cursorX, y - font->ascent, cursorX, y + font->descent - 1);
+    }
+}
 
-    int visibleRows = max(1, (winHeight - marginTop) / lineHeight);
+// Draw one tab's content. Only rows whose text changed since the previous
+// call, and the rows the cursor left or entered, are repainted; T.fullDamage
+// forces a repaint of the whole content area.
+static int drawScreen(Window win, GC gc, XFontStruct *font,
+                      TabState &T)
+{
+    // window metrics
+    int winWidth = win_state.width;
+    int winHeight = win_state.height;
+    int lineHeight = win_state.lineHeight;
+    int visibleRows = win_state.visibleRows;
+    Drawable d = canvas(win);
 
-    int totalLines = (int)displayLines.size();
+    init_colors();
+
+    const string promptPrefix = "swagnik@myterm:";
+
+    updateWrapCache(T, winWidth - MARGIN_LEFT - 10);
+
+    int totalLines = (int)T.wrapRows.size();
     if (T.scrollOffset < 0)
         T.scrollOffset = 0;
     if (T.scrollOffset > max(0, totalLines - visibleRows))
@@ -174,44 +397,20 @@ static int drawScreen(Window win, GC gc, XFontStruct *font,
     int start = T.scrollOffset;
     int end = min(totalLines, T.scrollOffset + visibleRows);
 
+    vector<ShownRow> rows(visibleRows);
     for (int row = start; row < end; ++row)
     {
-        int y = marginTop + (row - start) * lineHeight;
-        int x = marginLeft;
-        const DisplayLine &dl = displayLines[row];
-
-        unsigned long color = whitePixel;
-        string textToDraw = dl.text;
-
-        if (textToDraw.rfind("ERROR:", 0) == 0)
-        {
-            color = redPixel;
-            textToDraw = textToDraw.substr(7);
-        }
-
-        if (dl.promptChars > 0)
-        {
-            string ppart = textToDraw.substr(0, dl.promptChars);
-            XSetForeground(dpy, gc, greenPixel);
-            XDrawString(dpy, win, gc, x, y, ppart.c_str(), (int)ppart.length());
-            x += XTextWidth(font, ppart.c_str(), (int)ppart.length());
-
-            string rpart = textToDraw.substr(dl.promptChars);
-            if (!rpart.empty())
-            {
-                XSetForeground(dpy, gc, color);
-                XDrawString(dpy, win, gc, x, y, rpart.c_str(), (int)rpart.length());
-            }
-        }
-        else
-        {
-            XSetForeground(dpy, gc, color);
-            XDrawString(dpy, win, gc, x, y, textToDraw.c_str(), (int)textToDraw.length());
-        }
+        const WrapRow &wr = T.wrapRows[row];
+        const string &origLine = T.screenBuffer[wr.line];
+        ShownRow &r = rows[row - start];
+        r.text = origLine.substr(wr.start, wr.len);
+        if (wr.start == 0 && origLine.rfind(promptPrefix, 0) == 0)
+            r.promptChars = min(wr.len, (int)promptPrefix.size());
+        r.changed = wr.line < (int)T.lineMarks.size() && T.lineMarks[wr.line];
     }
 
-    // Cursor
-    if (T.showCursor)
+    // Cursor position
+    int cursorRow = -1, cursorX = 0;
     {
         string sdisp = formatPWD(T.cwd);
         string prompt = (sdisp == "/") ? "swagnik@myterm:" + sdisp + "$ " : "swagnik@myterm:~" + sdisp + "$ ";
@@ -246,59 +445,116 @@ static int drawScreen(Window win, GC gc, XFontStruct *font,
             if (T.isSearching)
             {
                 string searchPrompt = "Enter search term:";
-                int promptWidth = XTextWidth(font, searchPrompt.c_str(), searchPrompt.size());
                 uptoCursor = lines[curLine].substr(0, curCol);
-                int textWidth = XTextWidth(font, uptoCursor.c_str(), uptoCursor.size());
-                pxWidth = promptWidth + textWidth;
+                pxWidth = textWidth(searchPrompt) + textWidth(uptoCursor);
             }
             else if (T.inRec)
             {
                 string searchPrompt = "Choose from above options:";
-                int promptWidth = XTextWidth(font, searchPrompt.c_str(), searchPrompt.size());
                 uptoCursor = lines[curLine].substr(0, curCol);
-                int textWidth = XTextWidth(font, uptoCursor.c_str(), uptoCursor.size());
-                pxWidth = promptWidth + textWidth;
+                pxWidth = textWidth(searchPrompt) + textWidth(uptoCursor);
             }
             else
             {
                 uptoCursor = prompt + lines[curLine].substr(0, curCol);
-                pxWidth = XTextWidth(font, uptoCursor.c_str(), uptoCursor.size());
+                pxWidth = textWidth(uptoCursor);
             }
         }
         else
         {
             uptoCursor = lines[curLine].substr(0, curCol);
-            pxWidth = XTextWidth(font, uptoCursor.c_str(), uptoCursor.size());
+            pxWidth = textWidth(uptoCursor);
         }
 
-        int contentYOffset = NAVBAR_H + 30;
-        int marginLeftX = 10;
-        int cursorX = marginLeftX + pxWidth;
+        cursorX = MARGIN_LEFT + pxWidth;
         int cursorLineIndex = totalLines - ((int)lines.size() - curLine);
-
         if (cursorLineIndex >= start && cursorLineIndex < end)
-        {
-            int row = cursorLineIndex - start;
-            int baselineY = contentYOffset + row * lineHeight;
-            int yTop = baselineY - font->ascent;
-            int yBottom = baselineY + font->descent;
+            cursorRow = cursorLineIndex - start;
+    }
+    bool cursorOn = T.showCursor && cursorRow >= 0;
 
-            XSetForeground(dpy, gc, WhitePixel(dpy, scr));
-            XDrawLine(dpy, win, gc, cursorX, yTop, cursorX, yBottom);
+    // Damage: rows whose text changed, plus the old and new cursor rows
+    bool full = T.fullDamage || (int)T.shownRows.size() != visibleRows;
+    vector<char> dirty(visibleRows, full ? 1 : 0);
+    if (!full)
+    {
+        for (int i = 0; i < visibleRows; ++i)
+            if (rows[i].text != T.shownRows[i].text || rows[i].promptChars != T.shownRows[i].promptChars ||
+                rows[i].changed != T.shownRows[i].changed)
+                dirty[i] = 1;
+        if (cursorOn != T.shownCursorOn || cursorRow != T.shownCursorRow || cursorX != T.shownCursorX)
+        {
+            if (T.shownCursorOn && T.shownCursorRow >= 0 && T.shownCursorRow < visibleRows)
+                dirty[T.shownCursorRow] = 1;
+            if (cursorOn)
+                dirty[cursorRow] = 1;
         }
     }
 
-    return (int)displayLines.size();
+    if (full)
+    {
+        // Clear only content area (below navbar)
+        XSetForeground(dpy, gc, bg_pixel);
+        XFillRectangle(dpy, d, gc, 0, NAVBAR_H, winWidth, winHeight - NAVBAR_H);
+    }
+
+    int firstDirty = -1, lastDirty = -1;
+    for (int i = 0; i < visibleRows; ++i)
+    {
+        if (!dirty[i])
+            continue;
+        paint_row(d, gc, font, winWidth, i, rows[i], (cursorOn && i == cursorRow) ? cursorX : -1);
+        if (firstDirty < 0)
+            firstDirty = i;
+        lastDirty = i;
+    }
+
+    if (full)
+        present(win, gc, 0, NAVBAR_H, winWidth, winHeight - NAVBAR_H);
+    else if (firstDirty >= 0)
+        present(win, gc, 0, MARGIN_TOP - font->ascent + firstDirty * lineHeight,
+                winWidth, (lastDirty - firstDirty + 1) * lineHeight);
+
+    T.shownRows = std::move(rows);
+    T.shownCursorRow = cursorRow;
+    T.shownCursorX = cursorX;
+    T.shownCursorOn = cursorOn;
+    T.fullDamage = false;
+    return totalLines;
+}
+
+// Follow new output: scroll so the last row is at the bottom of the view.
+static void scroll_to_bottom(TabState &T)
+{
+    updateWrapCache(T, win_state.width - MARGIN_LEFT - 10);
+    T.scrollOffset = max(0, (int)T.wrapRows.size() - win_state.visibleRows);
+}
+
+// Cursor blink: repaint just the row under the cursor from what drawScreen
+// last painted, without looking at the scrollback again.
+static void blinkCursor(Window win, GC gc, XFontStruct *font, TabState &T)
+{
+    if (T.fullDamage || T.shownCursorRow < 0 || T.shownCursorRow >= (int)T.shownRows.size())
+    {
+        drawScreen(win, gc, font, T);
+        return;
+    }
+    int row = T.shownCursorRow;
+    paint_row(canvas(win), gc, font, win_state.width, row, T.shownRows[row],
+              T.showCursor ? T.shownCursorX : -1);
+    T.shownCursorOn = T.showCursor;
+    present(win, gc, 0, MARGIN_TOP - font->ascent + row * win_state.lineHeight, win_state.width, win_state.lineHeight);
 }
 
 // navbar drawing
 static void draw_navbar(Window win, GC gc, int win_w)
 {
+    Drawable d = canvas(win);
     XSetForeground(dpy, gc, BlackPixel(dpy, scr));
-    XFillRectangle(dpy, win, gc, 0, 0, win_w, NAVBAR_H);
+    XFillRectangle(dpy, d, gc, 0, 0, win_w, NAVBAR_H);
 
     XSetForeground(dpy, gc, WhitePixel(dpy, scr));
-    XDrawLine(dpy, win, gc, 0, NAVBAR_H - 1, win_w, NAVBAR_H - 1);
+    XDrawLine(dpy, d, gc, 0, NAVBAR_H - 1, win_w, NAVBAR_H - 1);
 }
 
 // tab chrome
@@ -321,9 +577,8 @@ bool hovered_plus = false;
 
 static vector<TabChromePos> draw_tabs(Window win, GC gc, XFontStruct *font)
 {
-    XWindowAttributes wa;
-    XGetWindowAttributes(dpy, win, &wa);
-    int win_w = wa.width;
+    int win_w = win_state.width;
+    Drawable d = canvas(win);
 
     vector<TabChromePos> pos;
 
@@ -369,27 +624,27 @@ for (size_t i = 0; i < tabs.size(); ++i)
     XSetForeground(dpy, gc, bg);
 
     // Four rounded corners
-    XFillArc(dpy, win, gc, x, y, radius * 2, radius * 2, 90 * 64, 90 * 64); // top-left
-    XFillArc(dpy, win, gc, x + tab_w - radius * 2, y, radius * 2, radius * 2, 0, 90 * 64); // top-right
-    XFillArc(dpy, win, gc, x, y + tab_h - radius * 2, radius * 2, radius * 2, 180 * 64, 90 * 64); // bottom-left
-    XFillArc(dpy, win, gc, x + tab_w - radius * 2, y + tab_h - radius * 2, radius * 2, radius * 2, 270 * 64, 90 * 64); // bottom-right
+    XFillArc(dpy, d, gc, x, y, radius * 2, radius * 2, 90 * 64, 90 * 64); // top-left
+    XFillArc(dpy, d, gc, x + tab_w - radius * 2, y, radius * 2, radius * 2, 0, 90 * 64); // top-right
+    XFillArc(dpy, d, gc, x, y + tab_h - radius * 2, radius * 2, radius * 2, 180 * 64, 90 * 64); // bottom-left
+    XFillArc(dpy, d, gc, x + tab_w - radius * 2, y + tab_h - radius * 2, radius * 2, radius * 2, 270 * 64, 90 * 64); // bottom-right
 
     // Connecting rectangles
-    XFillRectangle(dpy, win, gc, x + radius, y, tab_w - 2 * radius, tab_h);
-    XFillRectangle(dpy, win, gc, x, y + radius, tab_w, tab_h - 2 * radius);
+    XFillRectangle(dpy, d, gc, x + radius, y, tab_w - 2 * radius, tab_h);
+    XFillRectangle(dpy, d, gc, x, y + radius, tab_w, tab_h - 2 * radius);
 
     // Hover Outline Effect 
     if (hovered && !active)
     {
         XSetForeground(dpy, gc, 0x02CCFF); // cyan-blue border glow on hover
-        XDrawLine(dpy, win, gc, x + radius, y, x + tab_w - radius, y);
-        XDrawLine(dpy, win, gc, x + tab_w, y + radius, x + tab_w, y + tab_h - radius);
-        XDrawLine(dpy, win, gc, x + radius, y + tab_h, x + tab_w - radius, y + tab_h);
-        XDrawLine(dpy, win, gc, x, y + radius, x, y + tab_h - radius);
-        XDrawArc(dpy, win, gc, x, y, radius * 2, radius * 2, 90 * 64, 90 * 64);
-        XDrawArc(dpy, win, gc, x + tab_w - radius * 2, y, radius * 2, radius * 2, 0, 90 * 64);
-        XDrawArc(dpy, win, gc, x + tab_w - radius * 2, y + tab_h - radius * 2, radius * 2, radius * 2, 270 * 64, 90 * 64);
-        XDrawArc(dpy, win, gc, x, y + tab_h - radius * 2, radius * 2, radius * 2, 180 * 64, 90 * 64);
+        XDrawLine(dpy, d, gc, x + radius, y, x + tab_w - radius, y);
+        XDrawLine(dpy, d, gc, x + tab_w, y + radius, x + tab_w, y + tab_h - radius);
+        XDrawLine(dpy, d, gc, x + radius, y + tab_h, x + tab_w - radius, y + tab_h);
+        XDrawLine(dpy, d, gc, x, y + radius, x, y + tab_h - radius);
+        XDrawArc(dpy, d, gc, x, y, radius * 2, radius * 2, 90 * 64, 90 * 64);
+        XDrawArc(dpy, d, gc, x + tab_w - radius * 2, y, radius * 2, radius * 2, 0, 90 * 64);
+        XDrawArc(dpy, d, gc, x + tab_w - radius * 2, y + tab_h - radius * 2, radius * 2, radius * 2, 270 * 64, 90 * 64);
+        XDrawArc(dpy, d, gc, x, y + tab_h - radius * 2, radius * 2, radius * 2, 180 * 64, 90 * 64);
     }
 
     //  Active tab underline (shorter, rounded, slightly lower) 
@@ -405,19 +660,19 @@ for (size_t i = 0; i < tabs.size(); ++i)
         int underline_x = x + margin_x;
         int underline_w = tab_w - 2 * margin_x;
 
-        XFillRectangle(dpy, win, gc,
+        XFillRectangle(dpy, d, gc,
                        underline_x + end_radius,
                        underline_y,
                        underline_w - 2 * end_radius,
                        line_h);
 
-        XFillArc(dpy, win, gc,
+        XFillArc(dpy, d, gc,
                  underline_x,
                  underline_y,
                  line_h, line_h,
                  90 * 64, 180 * 64);
 
-        XFillArc(dpy, win, gc,
+        XFillArc(dpy, d, gc,
                  underline_x + underline_w - line_h,
                  underline_y,
                  line_h, line_h,
@@ -426,14 +681,14 @@ for (size_t i = 0; i < tabs.size(); ++i)
 
     //  Border (rounded outline) 
     XSetForeground(dpy, gc, border_color);
-    XDrawLine(dpy, win, gc, x + radius, y, x + tab_w - radius, y);
-    XDrawLine(dpy, win, gc, x + tab_w, y + radius, x + tab_w, y + tab_h - radius);
-    XDrawLine(dpy, win, gc, x + radius, y + tab_h, x + tab_w - radius, y + tab_h);
-    XDrawLine(dpy, win, gc, x, y + radius, x, y + tab_h - radius);
-    XDrawArc(dpy, win, gc, x, y, radius * 2, radius * 2, 90 * 64, 90 * 64);
-    XDrawArc(dpy, win, gc, x + tab_w - radius * 2, y, radius * 2, radius * 2, 0, 90 * 64);
-    XDrawArc(dpy, win, gc, x + tab_w - radius * 2, y + tab_h - radius * 2, radius * 2, radius * 2, 270 * 64, 90 * 64);
-    XDrawArc(dpy, win, gc, x, y + tab_h - radius * 2, radius * 2, radius * 2, 180 * 64, 90 * 64);
+    XDrawLine(dpy, d, gc, x + radius, y, x + tab_w - radius, y);
+    XDrawLine(dpy, d, gc, x + tab_w, y + radius, x + tab_w, y + tab_h - radius);
+    XDrawLine(dpy, d, gc, x + radius, y + tab_h, x + tab_w - radius, y + tab_h);
+    XDrawLine(dpy, d, gc, x, y + radius, x, y + tab_h - radius);
+    XDrawArc(dpy, d, gc, x, y, radius * 2, radius * 2, 90 * 64, 90 * 64);
+    XDrawArc(dpy, d, gc, x + tab_w - radius * 2, y, radius * 2, radius * 2, 0, 90 * 64);
+    XDrawArc(dpy, d, gc, x + tab_w - radius * 2, y + tab_h - radius * 2, radius * 2, radius * 2, 270 * 64, 90 * 64);
+    XDrawArc(dpy, d, gc, x, y + tab_h - radius * 2, radius * 2, radius * 2, 180 * 64, 90 * 64);
 
     //  Label Text 
     XCharStruct overall;
@@ -442,7 +697,7 @@ for (size_t i = 0; i < tabs.size(); ++i)
     int text_x = x + (tab_w - overall.width) / 2;
     int text_y = y + (tab_h + ascent - descent) / 2 + 2;
     XSetForeground(dpy, gc, textc);
-    XDrawString(dpy, win, gc, text_x, text_y, label.c_str(), (int)label.size());
+    XDrawString(dpy, d, gc, text_x, text_y, label.c_str(), (int)label.size());
 
     //  Close Button 
     int close_size = 18;
@@ -452,7 +707,7 @@ for (size_t i = 0; i < tabs.size(); ++i)
     unsigned long close_fg = 0xFFFFFF;
 
     XSetForeground(dpy, gc, close_bg);
-    XFillArc(dpy, win, gc, close_x, close_y, close_size, close_size, 0, 360 * 64);
+    XFillArc(dpy, d, gc, close_x, close_y, close_size, close_size, 0, 360 * 64);
 
     string cross = "X";
     XCharStruct cross_overall;
@@ -461,7 +716,7 @@ for (size_t i = 0; i < tabs.size(); ++i)
     int cx = close_x + (close_size - cross_overall.width) / 2;
     int cy = close_y + (close_size + ascent2 - descent2) / 2;
     XSetForeground(dpy, gc, close_fg);
-    XDrawString(dpy, win, gc, cx, cy, cross.c_str(), (int)cross.size());
+    XDrawString(dpy, d, gc, cx, cy, cross.c_str(), (int)cross.size());
 
     // Store positions
     pos.push_back({x, tab_w, close_x, close_size, false});
@@ -479,39 +734,39 @@ for (size_t i = 0; i < tabs.size(); ++i)
     XSetForeground(dpy, gc, plus_bg);
 
     // top left arc
-    XFillArc(dpy, win, gc, plus_x, plus_y, corner * 2, corner * 2, 90 * 64, 90 * 64);
+    XFillArc(dpy, d, gc, plus_x, plus_y, corner * 2, corner * 2, 90 * 64, 90 * 64);
     // top right arc
-    XFillArc(dpy, win, gc, plus_x + plus_w - corner * 2, plus_y, corner * 2, corner * 2, 0, 90 * 64);
+    XFillArc(dpy, d, gc, plus_x + plus_w - corner * 2, plus_y, corner * 2, corner * 2, 0, 90 * 64);
     // bottom right arc
-    XFillArc(dpy, win, gc, plus_x + plus_w - corner * 2, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 270 * 64, 90 * 64);
+    XFillArc(dpy, d, gc, plus_x + plus_w - corner * 2, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 270 * 64, 90 * 64);
     // bottom left arc
-    XFillArc(dpy, win, gc, plus_x, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 180 * 64, 90 * 64);
+    XFillArc(dpy, d, gc, plus_x, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 180 * 64, 90 * 64);
 
     // horizontal & vertical connecting rectangles
     // center horizontal body
-    XFillRectangle(dpy, win, gc, plus_x + corner, plus_y, plus_w - 2 * corner, tab_h);
+    XFillRectangle(dpy, d, gc, plus_x + corner, plus_y, plus_w - 2 * corner, tab_h);
     // left vertical body
-    XFillRectangle(dpy, win, gc, plus_x, plus_y + corner, corner, tab_h - 2 * corner);
+    XFillRectangle(dpy, d, gc, plus_x, plus_y + corner, corner, tab_h - 2 * corner);
     // right vertical body
-    XFillRectangle(dpy, win, gc, plus_x + plus_w - corner, plus_y + corner, corner, tab_h - 2 * corner);
+    XFillRectangle(dpy, d, gc, plus_x + plus_w - corner, plus_y + corner, corner, tab_h - 2 * corner);
 
     //  Draw border outline with rounded corners 
     XSetForeground(dpy, gc, 0x000000);
 
     // top line (between arcs)
-    XDrawLine(dpy, win, gc, plus_x + corner, plus_y, plus_x + plus_w - corner, plus_y);
+    XDrawLine(dpy, d, gc, plus_x + corner, plus_y, plus_x + plus_w - corner, plus_y);
     // right line
-    XDrawLine(dpy, win, gc, plus_x + plus_w, plus_y + corner, plus_x + plus_w, plus_y + tab_h - corner);
+    XDrawLine(dpy, d, gc, plus_x + plus_w, plus_y + corner, plus_x + plus_w, plus_y + tab_h - corner);
     // bottom line
-    XDrawLine(dpy, win, gc, plus_x + corner, plus_y + tab_h, plus_x + plus_w - corner, plus_y + tab_h);
+    XDrawLine(dpy, d, gc, plus_x + corner, plus_y + tab_h, plus_x + plus_w - corner, plus_y + tab_h);
     // left line
-    XDrawLine(dpy, win, gc, plus_x, plus_y + corner, plus_x, plus_y + tab_h - corner);
+    XDrawLine(dpy, d, gc, plus_x, plus_y + corner, plus_x, plus_y + tab_h - corner);
 
     // draw corner arcs for the border
-    XDrawArc(dpy, win, gc, plus_x, plus_y, corner * 2, corner * 2, 90 * 64, 90 * 64);
-    XDrawArc(dpy, win, gc, plus_x + plus_w - corner * 2, plus_y, corner * 2, corner * 2, 0, 90 * 64);
-    XDrawArc(dpy, win, gc, plus_x + plus_w - corner * 2, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 270 * 64, 90 * 64);
-    XDrawArc(dpy, win, gc, plus_x, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 180 * 64, 90 * 64);
+    XDrawArc(dpy, d, gc, plus_x, plus_y, corner * 2, corner * 2, 90 * 64, 90 * 64);
+    XDrawArc(dpy, d, gc, plus_x + plus_w - corner * 2, plus_y, corner * 2, corner * 2, 0, 90 * 64);
+    XDrawArc(dpy, d, gc, plus_x + plus_w - corner * 2, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 270 * 64, 90 * 64);
+    XDrawArc(dpy, d, gc, plus_x, plus_y + tab_h - corner * 2, corner * 2, corner * 2, 180 * 64, 90 * 64);
 
     // Centered "+" 
     string plus = "+";
@@ -521,13 +776,30 @@ for (size_t i = 0; i < tabs.size(); ++i)
 
     int px = plus_x + (plus_w - p_overall.width) / 2;
     int py = plus_y + (tab_h + ascent_p - descent_p) / 2 + 2;
-    XDrawString(dpy, win, gc, px, py, plus.c_str(), (int)plus.size());
+    XDrawString(dpy, d, gc, px, py, plus.c_str(), (int)plus.size());
 
     pos.push_back({plus_x, plus_w, plus_x, plus_w, true});
 
+    present(win, gc, 0, 0, win_w, NAVBAR_H);
     return pos;
 }
 
+// full redraw: navbar, tabs and the active tab, presented in one copy
+static void draw_frame(Window win, GC gc, XFontStruct *font)
+{
+    frame_open = true;
+    draw_navbar(win, gc, win_state.width);
+    draw_tabs(win, gc, font);
+    if (active_tab >= 0 && active_tab < (int)tabs.size())
+    {
+        tabs[active_tab].fullDamage = true;
+        drawScreen(win, gc, font, tabs[active_tab]);
+    }
+    frame_open = false;
+    backbuf_ready = true;
+    present(win, gc, 0, 0, win_state.width, win_state.height);
+}
+
 // Returns:
 //  -2 if "+" button clicked
 //  -3 if a close button clicked (and sets out_index)
@@ -580,6 +852,7 @@ static void add_tab(const string &initial_cwd = "/")
     t.title = "Tab " + to_string((int)tabs.size() + 1);
     tabs.push_back(std::move(t));
     active_tab = (int)tabs.size() - 1;
+    prefetchDirectories(initial_cwd);
 }
 
 
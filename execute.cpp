@@ -25,7 +25,13 @@
 #include <sys/stat.h>
 #include <limits.h>
 
+#include <pty.h>
+#include <termios.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+
 #include "drawscreen.cpp"
+#include "helper/spawn.cpp"
 using namespace std;
 
 
@@ -33,19 +39,17 @@ using namespace std;
 extern vector<TabState> tabs;
 
 
-// Globals used by execute.cpp
-
-static mutex current_pids_mutex;
-static vector<pid_t> current_child_pids; // guarded by current_pids_mutex
-
-// Flags
-atomic<bool> mw_stop_requested(false); // set by UI to request multiWatch stop
-atomic<bool> mw_finished(false);       // set by multiWatch when it completed & restored
-atomic<bool> cmd_running(false);       // true while execCommand or multiWatch is running
-
-// Async-safe small flag for signal handler/UI -> execute communication
-static volatile sig_atomic_t sigint_request_flag = 0;
+// eventfd the UI loop polls on; workers write to it after changing UI state
+static int ui_wake_fd = -1;
 
+static void wake_ui()
+{
+    if (ui_wake_fd < 0)
+        return;
+    uint64_t one = 1;
+    ssize_t r = write(ui_wake_fd, &one, sizeof(one));
+    (void)r;
+}
 
 // Utility
 
@@ -60,861 +64,1427 @@ static string getCurrentTime()
 }
 
 
-// notify_sigint_from_ui
-
+static string trimBlanks(string s)
+{
+    s.erase(0, s.find_first_not_of(" \t"));
+    if (!s.empty())
+        s.erase(s.find_last_not_of(" \t") + 1);
+    return s;
+}
 
-extern "C" void notify_sigint_from_ui()
+// Tab-local cd. Returns true if `trimmed` is a cd command; its result line
+// (empty, or an error) is stored in `out`.
+static bool tryBuiltinCd(const string &trimmed, string &cwd_for_tab, vector<string> &out)
 {
-    // Request stop of multiWatch and other loops
-    mw_stop_requested.store(true);
+    if (trimmed == "cd" || trimmed == "cd ~")
+    {
+        const char *home = getenv("HOME");
+        cwd_for_tab = home ? string(home) : string("/");
+        out = {""};
+        return true;
+    }
+    if (trimmed.rfind("cd ", 0) != 0)
+        return false;
 
-    
-    sigint_request_flag = 1;
+    string path = trimBlanks(trimmed.substr(3));
+    string target;
+    if (path.empty() || path == "~")
+    {
+        const char *home = getenv("HOME");
+        target = home ? string(home) : string("/");
+    }
+    else if (path[0] == '/')
+        target = path;
+    else
+        target = cwd_for_tab + "/" + path;
 
-   
+    char resolved[PATH_MAX];
+    if (realpath(target.c_str(), resolved))
     {
-        lock_guard<mutex> lk(current_pids_mutex);
-        for (pid_t p : current_child_pids)
+        struct stat st{};
+        if (stat(resolved, &st) == 0 && S_ISDIR(st.st_mode))
         {
-            if (p > 0)
-                kill(p, SIGINT);
+            cwd_for_tab = resolved;
+            out = {""};
+            return true;
         }
     }
+    out = {string("ERROR: cd: no such file or directory: ") + path};
+    return true;
 }
 
+// A command started from a tab prompt. The UI loop polls outFd/errFd and
+// streams what arrives into the tab (pumpJob), so it never waits on a child.
+struct Job
+{
+    vector<pid_t> pids;
+    int outFd = -1, errFd = -1;
+    string outPartial, errPartial; // output after the last newline
+    bool anyOutput = false;
+    bool failed = false;
+    int lastStatus = 0;
+    bool viaShell = false; // outFd is the tab's PtyShell master, not ours to close
+    int exitFd = -1;       // pidfd of exitPid, polled once both pipes are closed
+    pid_t exitPid = -1;
 
-static void handle_pending_sigint()
+    ~Job()
+    {
+        // tab closed while the command was still running
+        if (outFd >= 0 && !viaShell)
+            close(outFd);
+        if (errFd >= 0)
+            close(errFd);
+        if (exitFd >= 0)
+            close(exitFd);
+        for (pid_t p : pids)
+        {
+            kill(p, SIGKILL);
+            waitpid(p, nullptr, 0);
+        }
+    }
+};
+
+// One redirection of a pipeline stage: open `path` onto `fd`, or, when
+// path is empty, make `fd` a copy of `dupFrom` (2>&1).
+struct Redir
 {
-    if (sigint_request_flag == 0)
-        return;
-    // clear flag
-    sigint_request_flag = 0;
+    int fd = -1;
+    string path;
+    int flags = 0;
+    int dupFrom = -1;
+};
 
-    lock_guard<mutex> lk(current_pids_mutex);
-    for (pid_t p : current_child_pids)
+struct Stage
+{
+    vector<string> argv;
+    vector<Redir> redirs; // applied in order, after the pipe plumbing
+};
+
+// builtins and keywords that only mean something inside a shell; a stage
+// starting with one of these goes to bash
+static const unordered_set<string> shellOnlyWords = {
+    "alias", "bg", "bind", "break", "builtin", "caller", "case", "command",
+    "compgen", "complete", "continue", "declare", "dirs", "disown", "do",
+    "done", "elif", "else", "enable", "esac", "eval", "exec", "exit",
+    "export", "fc", "fg", "fi", "for", "function", "getopts", "hash", "help",
+    "history", "if", "jobs", "let", "local", "logout", "mapfile", "popd",
+    "pushd", "read", "readarray", "readonly", "return", "select", "set",
+    "shift", "shopt", "source", ".", "suspend", "then", "time", "times",
+    "trap", "type", "typeset", "ulimit", "umask", "unalias", "unset",
+    "until", "wait", "while", "cd", "[[", "coproc"};
+
+// true if `name` would run an executable file (looked up like execvp)
+static bool findExecutable(const string &name, const string &cwd)
+{
+    if (name.find('/') != string::npos)
     {
-        if (p > 0)
-            kill(p, SIGINT);
+        string path = (name[0] == '/' || cwd.empty()) ? name : cwd + "/" + name;
+        struct stat st{};
+        return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(path.c_str(), X_OK) == 0;
     }
+    const char *env = getenv("PATH");
+    string path = env ? env : "/usr/local/bin:/usr/bin:/bin";
+    size_t from = 0;
+    while (from <= path.size())
+    {
+        size_t to = path.find(':', from);
+        if (to == string::npos)
+            to = path.size();
+        string dir = path.substr(from, to - from);
+        string full = (dir.empty() ? string(".") : dir) + "/" + name;
+        struct stat st{};
+        if (stat(full.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(full.c_str(), X_OK) == 0)
+            return true;
+        from = to + 1;
+    }
+    return false;
 }
-vector<string> execCommandInDir(const string &cmd, string &cwd_for_tab)
+
+// Split `cmd` into pipeline stages ourselves: words with quotes and
+// backslash escapes, `|`, and `<`, `>`, `>>`, `2>`, `2>>`, `2>&1`, `>&2` redirections.
+// Returns false for anything else (variables, globs, ~, ;, &&, subshells,
+// heredocs, assignments, shell builtins, unknown commands) so the caller
+// can hand the whole line to bash instead.
+static bool parsePipeline(const string &cmd, const string &cwd, vector<Stage> &stages)
 {
-    if (cmd.empty())
-        return {""};
+    stages.assign(1, Stage{});
+    size_t i = 0, n = cmd.size();
+    auto isBlank = [](char c) { return c == ' ' || c == '\t'; };
 
-    auto trim = [](string s)
+    while (true)
     {
-        s.erase(0, s.find_first_not_of(" \t"));
-        if (!s.empty())
-            s.erase(s.find_last_not_of(" \t") + 1);
-        return s;
-    };
+        while (i < n && isBlank(cmd[i]))
+            ++i;
+        if (i >= n)
+            break;
 
-    string trimmed = trim(cmd);
+        char c = cmd[i];
+        if (c == '|')
+        {
+            if (i + 1 < n && (cmd[i + 1] == '|' || cmd[i + 1] == '&'))
+                return false;
+            if (stages.back().argv.empty())
+                return false;
+            stages.push_back(Stage{});
+            ++i;
+            continue;
+        }
 
-    // tab-local cd
-    if (trimmed.rfind("cd ", 0) == 0)
-    {
-        string path = trim(trimmed.substr(3));
-        string target;
-        if (path.empty() || path == "~")
+        // redirection operator, with an optional fd in front: bash takes any
+        // all-digit word touching `<`/`>` as one, we only do 0-2
+        int fd = -1;
+        size_t op = i;
+        while (op < n && isdigit((unsigned char)cmd[op]))
+            ++op;
+        if (op > i && op < n && (cmd[op] == '<' || cmd[op] == '>'))
         {
-            const char *home = getenv("HOME");
-            target = home ? string(home) : string("/");
+            if (op - i > 1)
+                return false; // 12>x, 00>x
+            fd = c - '0';
         }
-        else if (path[0] == '/')
-            target = path;
         else
-            target = cwd_for_tab + "/" + path;
+            op = i;
+        if (cmd[op] == '<' || cmd[op] == '>')
+        {
+            bool out = cmd[op] == '>';
+            if (fd < 0)
+                fd = out ? STDOUT_FILENO : STDIN_FILENO;
+            if (fd > STDERR_FILENO)
+                return false;
+            size_t j = op + 1;
+            bool append = false;
+            if (out && j < n && cmd[j] == '>')
+            {
+                append = true;
+                ++j;
+            }
+            Redir r;
+            r.fd = fd;
+            if (j < n && cmd[j] == '&')
+            {
+                // only the plain fd copies: 2>&1, >&2
+                if (!out || append || j + 1 >= n || (cmd[j + 1] != '1' && cmd[j + 1] != '2') ||
+                    (j + 2 < n && !isBlank(cmd[j + 2]) && cmd[j + 2] != '|'))
+                    return false;
+                r.dupFrom = cmd[j + 1] - '0';
+                stages.back().redirs.push_back(r);
+                i = j + 2;
+                continue;
+            }
+            if (j < n && (cmd[j] == '<' || cmd[j] == '>' || cmd[j] == '|' || cmd[j] == '('))
+                return false; // <<, <>, >|, <( ... )
+            i = j;
+            while (i < n && isBlank(cmd[i]))
+                ++i;
+            if (i >= n || cmd[i] == '|' || cmd[i] == '<' || cmd[i] == '>')
+                return false;
+            fd = -2; // the next word is the target
+            r.flags = out ? (O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC)) : O_RDONLY;
+            stages.back().redirs.push_back(r);
+        }
 
-        char resolved[PATH_MAX];
-        if (realpath(target.c_str(), resolved))
+        // one word
+        string word;
+        bool sawAny = false;
+        while (i < n && !isBlank(cmd[i]))
         {
-            struct stat st{};
-            if (stat(resolved, &st) == 0 && S_ISDIR(st.st_mode))
+            char ch = cmd[i];
+            if (ch == '|' || ch == '<' || ch == '>')
+                break;
+            // ~ and # only matter at the start of a word, but keep it simple
+            if (strchr("$`*?[]{}~;&()#!", ch))
+                return false;
+            if (ch == '=' && fd != -2 && stages.back().argv.empty())
+                return false; // NAME=value prefix
+            if (ch == '\\')
+            {
+                if (i + 1 >= n)
+                    return false;
+                word += cmd[i + 1];
+                i += 2;
+            }
+            else if (ch == '\'')
             {
-                cwd_for_tab = resolved;
-                return {""};
+                size_t close = cmd.find('\'', i + 1);
+                if (close == string::npos)
+                    return false;
+                word.append(cmd, i + 1, close - i - 1);
+                i = close + 1;
             }
+            else if (ch == '"')
+            {
+                ++i;
+                while (i < n && cmd[i] != '"')
+                {
+                    if (cmd[i] == '$' || cmd[i] == '`')
+                        return false;
+                    if (cmd[i] == '\\' && i + 1 < n && strchr("\\\"$`", cmd[i + 1]))
+                        ++i;
+                    word += cmd[i++];
+                }
+                if (i >= n)
+                    return false;
+                ++i;
+            }
+            else
+            {
+                word += ch;
+                ++i;
+            }
+            sawAny = true;
         }
-        return {string("ERROR: cd: no such file or directory: ") + path};
+        if (!sawAny)
+            return false;
+
+        if (fd == -2)
+            stages.back().redirs.back().path = word;
+        else
+            stages.back().argv.push_back(word);
     }
-    if (trimmed == "cd" || trimmed == "cd ~")
+
+    for (auto &st : stages)
     {
-        const char *home = getenv("HOME");
-        cwd_for_tab = home ? string(home) : string("/");
-        return {""};
+        if (st.argv.empty())
+            return false;
+        if (shellOnlyWords.count(st.argv[0]) || !findExecutable(st.argv[0], cwd))
+            return false; // let bash run it or report it
     }
+    return true;
+}
 
-    // Pipeline split
-    vector<string> parts;
+// Start the stages of `cmd` inside `cwd`. Simple pipelines are exec'd
+// directly (parsePipeline); anything else runs as one `bash -c`. On success
+// the stage pids and the read ends of the stdout/stderr capture pipes are
+// left in `job` and "" is returned; otherwise an error line.
+static string launchPipeline(const string &cmd, const string &cwd, Job &job)
+{
+    vector<Stage> stages;
+    if (!parsePipeline(cmd, cwd, stages))
     {
-        stringstream ss(cmd);
-        string p;
-        while (getline(ss, p, '|'))
-        {
-            p.erase(0, p.find_first_not_of(" \t"));
-            if (!p.empty())
-                p.erase(p.find_last_not_of(" \t") + 1);
-            if (!p.empty())
-                parts.push_back(p);
-        }
+        stages.assign(1, Stage{});
+        stages[0].argv = {"bash", "-c", cmd};
     }
-    if (parts.empty())
-        return {""};
 
-    int n = (int)parts.size();
+    int n = (int)stages.size();
     int numPipes = max(0, n - 1);
 
+    // redirection targets are opened here so a bad path is reported once,
+    // before anything runs
+    vector<vector<int>> redirFds(n);
+    auto closeRedirs = [&]()
+    {
+        for (auto &v : redirFds)
+            for (int fd : v)
+                if (fd >= 0)
+                    close(fd);
+    };
+    for (int i = 0; i < n; ++i)
+    {
+        for (auto &r : stages[i].redirs)
+        {
+            int fd = -1;
+            if (r.dupFrom < 0)
+            {
+                string full = (r.path[0] == '/' || cwd.empty()) ? r.path : cwd + "/" + r.path;
+                fd = open(full.c_str(), r.flags | O_CLOEXEC, 0666);
+                if (fd < 0)
+                {
+                    string err = "ERROR: " + r.path + ": " + strerror(errno);
+                    closeRedirs();
+                    return err;
+                }
+            }
+            redirFds[i].push_back(fd);
+        }
+    }
+
     vector<int> chainFds(2 * numPipes, -1);
     for (int i = 0; i < numPipes; ++i)
     {
-        if (pipe(chainFds.data() + i * 2) < 0)
+        if (pipe2(chainFds.data() + i * 2, O_CLOEXEC) < 0)
         {
             for (int j = 0; j < i; ++j)
             {
                 close(chainFds[j * 2]);
                 close(chainFds[j * 2 + 1]);
             }
-            return {"ERROR: pipe creation failed"};
+            closeRedirs();
+            return "ERROR: pipe creation failed";
         }
     }
 
     int capture_out[2] = {-1, -1}, capture_err[2] = {-1, -1};
-    if (pipe(capture_out) < 0)
+    if (pipe2(capture_out, O_CLOEXEC) < 0)
     {
         for (int fd : chainFds)
             if (fd >= 0)
                 close(fd);
-        return {"ERROR: capture_out pipe failed"};
+        closeRedirs();
+        return "ERROR: capture_out pipe failed";
     }
-    if (pipe(capture_err) < 0)
+    if (pipe2(capture_err, O_CLOEXEC) < 0)
     {
         close(capture_out[0]);
         close(capture_out[1]);
         for (int fd : chainFds)
             if (fd >= 0)
                 close(fd);
-        return {"ERROR: capture_err pipe failed"};
+        closeRedirs();
+        return "ERROR: capture_err pipe failed";
     }
 
     vector<pid_t> pids;
-    bool forkError = false;
-
-    cmd_running.store(true);
-    {
-        lock_guard<mutex> lk(current_pids_mutex);
-        current_child_pids.clear();
-    }
+    int spawnErrno = 0;
 
     for (int i = 0; i < n; ++i)
     {
-        pid_t pid = fork();
-        if (pid < 0)
+        SpawnSpec spec;
+        spec.argv = stages[i].argv;
+        spec.cwd = cwd;
+        if (i > 0)
+            spec.dups.push_back({chainFds[(i - 1) * 2], STDIN_FILENO});
+        spec.dups.push_back({i < numPipes ? chainFds[i * 2 + 1] : capture_out[1], STDOUT_FILENO});
+        spec.dups.push_back({capture_err[1], STDERR_FILENO});
+        for (size_t k = 0; k < stages[i].redirs.size(); ++k)
         {
-            forkError = true;
-            break;
+            const Redir &r = stages[i].redirs[k];
+            spec.dups.push_back({r.dupFrom >= 0 ? r.dupFrom : redirFds[i][k], r.fd});
         }
-        if (pid == 0)
-        {
-            // Child: change cwd then exec
-            if (!cwd_for_tab.empty())
-                chdir(cwd_for_tab.c_str());
-
-            if (i > 0)
-                dup2(chainFds[(i - 1) * 2], STDIN_FILENO);
-            if (i < numPipes)
-                dup2(chainFds[i * 2 + 1], STDOUT_FILENO);
-            else
-                dup2(capture_out[1], STDOUT_FILENO);
-            dup2(capture_err[1], STDERR_FILENO);
 
-            for (int fd : chainFds)
-                if (fd >= 0)
-                    close(fd);
-            close(capture_out[0]);
-            close(capture_out[1]);
-            close(capture_err[0]);
-            close(capture_err[1]);
-
-            execlp("bash", "bash", "-c", parts[i].c_str(), (char *)NULL);
-            _exit(127);
+        pid_t pid = spawnProcess(spec);
+        if (pid < 0)
+        {
+            spawnErrno = errno;
+            break;
         }
-        else
-            pids.push_back(pid);
+        pids.push_back(pid);
     }
 
-    if (forkError)
+    for (int fd : chainFds)
+        if (fd >= 0)
+            close(fd);
+    close(capture_out[1]);
+    close(capture_err[1]);
+    closeRedirs();
+
+    if (spawnErrno != 0)
     {
-        for (int fd : chainFds)
-            if (fd >= 0)
-                close(fd);
         close(capture_out[0]);
-        close(capture_out[1]);
         close(capture_err[0]);
-        close(capture_err[1]);
         for (pid_t p : pids)
             if (p > 0)
                 waitpid(p, nullptr, 0);
-        cmd_running.store(false);
-        return {"ERROR: fork failed"};
+        return string("ERROR: cannot start command: ") + strerror(spawnErrno);
     }
 
-    for (int fd : chainFds)
-        if (fd >= 0)
-            close(fd);
-    close(capture_out[1]);
-    close(capture_err[1]);
+    job.pids = std::move(pids);
+    job.outFd = capture_out[0];
+    job.errFd = capture_err[0];
+    return "";
+}
 
-    // record pids
+// Start `cmd` for tab T without waiting for it. Returns false when there is
+// nothing to wait for (cd, empty command, launch error); the lines to show
+// are then in `out`. Otherwise T.job is set and the UI loop streams it.
+static bool startJob(const string &cmd, TabState &T, vector<string> &out)
+{
+    out.clear();
+    if (cmd.empty())
     {
-        lock_guard<mutex> lk(current_pids_mutex);
-        current_child_pids = pids;
+        out = {""};
+        return false;
     }
-
-    // read with poll (same as execCommand)
-    string outBuf, errBuf;
-    const int BUF_SZ = 4096;
-    char buffer[BUF_SZ];
-    struct pollfd pfds[2];
-    pfds[0].fd = capture_out[0];
-    pfds[0].events = POLLIN | POLLHUP | POLLERR;
-    pfds[1].fd = capture_err[0];
-    pfds[1].events = POLLIN | POLLHUP | POLLERR;
-
-    int active = 2;
-    while (active > 0)
+    string before = T.cwd;
+    if (tryBuiltinCd(trimBlanks(cmd), T.cwd, out))
     {
-        handle_pending_sigint();
-
-        int r = poll(pfds, 2, -1);
-        if (r < 0)
-        {
-            if (errno == EINTR)
-            {
-                handle_pending_sigint();
-                continue;
-            }
-            break;
-        }
-
-        for (int i = 0; i < 2; ++i)
-        {
-            if (pfds[i].fd < 0)
-                continue;
-            if (pfds[i].revents & POLLIN)
-            {
-                ssize_t n = read(pfds[i].fd, buffer, BUF_SZ);
-                if (n > 0)
-                {
-                    if (i == 0)
-                        outBuf.append(buffer, n);
-                    else
-                        errBuf.append(buffer, n);
-                }
-                else
-                {
-                    close(pfds[i].fd);
-                    pfds[i].fd = -1;
-                    active--;
-                }
-            }
-            else if (pfds[i].revents & (POLLHUP | POLLERR))
-            {
-                while (true)
-                {
-                    ssize_t n = read(pfds[i].fd, buffer, BUF_SZ);
-                    if (n > 0)
-                    {
-                        if (i == 0)
-                            outBuf.append(buffer, n);
-                        else
-                            errBuf.append(buffer, n);
-                    }
-                    else
-                        break;
-                }
-                if (pfds[i].fd >= 0)
-                {
-                    close(pfds[i].fd);
-                    pfds[i].fd = -1;
-                    active--;
-                }
-            }
-        }
+        if (T.cwd != before)
+            prefetchDirectories(T.cwd);
+        return false;
     }
 
-    if (pfds[0].fd >= 0)
+    auto job = make_shared<Job>();
+    string launchErr = launchPipeline(cmd, T.cwd, *job);
+    if (!launchErr.empty() || job->pids.empty())
     {
-        close(pfds[0].fd);
-        pfds[0].fd = -1;
+        out = {launchErr};
+        return false;
     }
-    if (pfds[1].fd >= 0)
+    fcntl(job->outFd, F_SETFL, O_NONBLOCK);
+    fcntl(job->errFd, F_SETFL, O_NONBLOCK);
+    T.job = job;
+    return true;
+}
+
+// Split freshly read bytes into lines and append the complete ones to the
+// tab; stderr lines get the "ERROR: " prefix drawScreen colours red.
+static void appendJobOutput(TabState &T, string &partial, const char *buf, size_t n, bool isErr)
+{
+    partial.append(buf, n);
+    size_t pos = 0, nl;
+    while ((nl = partial.find('\n', pos)) != string::npos)
     {
-        close(pfds[1].fd);
-        pfds[1].fd = -1;
+        string line = partial.substr(pos, nl - pos);
+        T.screenBuffer.push_back(isErr ? "ERROR: " + line : line);
+        pos = nl + 1;
     }
+    partial.erase(0, pos);
+    if (n > 0)
+        T.job->anyOutput = true;
+}
 
-    // wait children
-    bool hadError = false;
-    int lastStatus = 0;
-    for (pid_t p : pids)
+// Reap the stages of a job whose pipes are closed. Returns true once all of
+// them have exited; the final status line (if any) is appended then.
+static bool reapJob(TabState &T)
+{
+    Job &job = *T.job;
+    for (size_t i = 0; i < job.pids.size();)
     {
         int status = 0;
-        if (waitpid(p, &status, 0) < 0)
-            hadError = true;
+        pid_t r = waitpid(job.pids[i], &status, WNOHANG);
+        if (r == 0)
+        {
+            ++i;
+            continue;
+        }
+        if (r < 0)
+            job.failed = true;
         else
         {
-            lastStatus = status;
+            job.lastStatus = status;
             if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
-                hadError = true;
+                job.failed = true;
         }
+        job.pids.erase(job.pids.begin() + i);
     }
+    if (!job.pids.empty())
+        return false;
 
+    if (job.failed && !job.anyOutput)
     {
-        lock_guard<mutex> lk(current_pids_mutex);
-        current_child_pids.clear();
+        int exitCode = (WIFEXITED(job.lastStatus) ? WEXITSTATUS(job.lastStatus) : -1);
+        T.screenBuffer.push_back(string("ERROR: (process exited with code ") + to_string(exitCode) + ")");
     }
-    cmd_running.store(false);
+    T.job.reset();
+    return true;
+}
 
-    if (!errBuf.empty())
-        hadError = true;
+// A job whose pipes are closed may still be running (`sleep 600 >/dev/null
+// 2>&1`). The UI loop then waits on a pidfd for its first unreaped process
+// and calls reapJob() when that becomes readable. -1 when pidfd_open is
+// not available (ENOSYS before Linux 5.3, EPERM under seccomp): the loop
+// then falls back to retrying reapJob() every REAP_POLL_MS.
+static const int REAP_POLL_MS = 20;
 
-    auto splitLines = [](const string &s) -> vector<string>
+static int jobExitFd(Job &job)
+{
+    if (job.pids.empty())
+        return -1;
+    if (job.exitPid == job.pids.front())
+        return job.exitFd; // tried already, whether or not it worked
+    if (job.exitFd >= 0)
+        close(job.exitFd);
+    job.exitPid = job.pids.front();
+    job.exitFd = (int)syscall(SYS_pidfd_open, job.exitPid, 0);
+    return job.exitFd;
+}
+
+static bool pumpShell(TabState &T);
+
+// Consume what is ready on `fd`, one of T.job's capture pipes. At most one
+// buffer is read per call so a chatty command cannot starve the X events.
+// Returns true when the job has completely finished.
+static bool pumpJob(TabState &T, int fd)
+{
+    if (T.job->viaShell)
+        return pumpShell(T);
+
+    Job &job = *T.job;
+    bool isErr = (fd == job.errFd);
+    string &partial = isErr ? job.errPartial : job.outPartial;
+
+    char buffer[65536];
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n > 0)
     {
-        vector<string> out;
-        size_t pos = 0;
-        while (pos < s.size())
-        {
-            size_t nl = s.find('\n', pos);
-            if (nl == string::npos)
-            {
-                out.push_back(s.substr(pos));
-                break;
-            }
-            out.push_back(s.substr(pos, nl - pos));
-            pos = nl + 1;
-        }
-        return out;
-    };
+        appendJobOutput(T, partial, buffer, (size_t)n, isErr);
+        return false;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return false;
+
+    // EOF: flush an unterminated last line and close this side
+    if (!partial.empty())
+        appendJobOutput(T, partial, "\n", 1, isErr);
+    close(fd);
+    (isErr ? job.errFd : job.outFd) = -1;
+    if (job.outFd >= 0 || job.errFd >= 0)
+        return false;
+    return reapJob(T);
+}
 
-    vector<string> outLines = splitLines(outBuf);
-    vector<string> errLines = splitLines(errBuf);
+// Optional per-tab shell ("pty on"): one bash on a pseudo-terminal that
+// keeps its variables, aliases, functions and cwd between commands. Its
+// PROMPT_COMMAND prints `token`, the exit status and $PWD before every
+// prompt; seeing that line in the output marks the end of the command.
+struct PtyShell
+{
+    pid_t pid = -1;
+    int masterFd = -1;
+    string token;
 
-    vector<string> result;
-    if (hadError)
+    ~PtyShell()
     {
-        if (!errLines.empty())
-            for (auto &l : errLines)
-                result.push_back(string("ERROR: ") + l);
-        else if (!outLines.empty())
-            for (auto &l : outLines)
-                result.push_back(string("ERROR: ") + l);
-        else
+        if (masterFd >= 0)
+            close(masterFd);
+        if (pid > 0)
         {
-            int exitCode = (WIFEXITED(lastStatus) ? WEXITSTATUS(lastStatus) : -1);
-            result.push_back(string("ERROR: (process exited with code ") + to_string(exitCode) + ")");
+            kill(pid, SIGHUP);
+            waitpid(pid, nullptr, 0);
         }
     }
-    else
+};
+
+static shared_ptr<PtyShell> startShell(const string &cwd)
+{
+    auto sh = make_shared<PtyShell>();
+    int slaveFd = -1;
+    char slaveName[PATH_MAX];
+    if (openpty(&sh->masterFd, &slaveFd, slaveName, nullptr, nullptr) < 0)
+        return nullptr;
+
+    // no echo of what we write and no \r added to output; set before the
+    // spawn so nothing written early can be echoed back
+    struct termios tio;
+    if (tcgetattr(slaveFd, &tio) == 0)
     {
-        result = std::move(outLines);
-        if (result.empty())
-            result.push_back("");
+        tio.c_lflag &= ~(ECHO | ECHONL);
+        tio.c_oflag &= ~ONLCR;
+        tcsetattr(slaveFd, TCSANOW, &tio);
     }
 
-    return result;
+    // the shell reports each finished command itself, from PROMPT_COMMAND;
+    // nothing but the user's command ever goes to its stdin, so a command
+    // that reads stdin cannot swallow the sentinel
+    static atomic<unsigned> shellCount{0};
+    sh->token = "__myterm_done_" + to_string(getpid()) + "_" + to_string(++shellCount) + "__";
+    SpawnSpec spec;
+    spec.argv = {"bash", "--noprofile", "--norc", "--noediting"};
+    spec.cwd = cwd;
+    spec.openTty = slaveName;
+    spec.env = {"PS1=", "PS2=", "TERM=dumb",
+                "PROMPT_COMMAND=printf '%s %d %s\\n' " + sh->token + " \"$?\" \"$PWD\""};
+    pid_t pid = spawnProcess(spec);
+    close(slaveFd);
+    if (pid < 0)
+        return nullptr;
+    sh->pid = pid;
+    fcntl(sh->masterFd, F_SETFD, FD_CLOEXEC);
+    fcntl(sh->masterFd, F_SETFL, O_NONBLOCK);
+
+    // the first prompt says the shell is up; drop it so it is not taken
+    // for the end of the first command
+    string seen;
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+    while (seen.find(sh->token) == string::npos || seen.back() != '\n')
+    {
+        int left = (int)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        pollfd p{sh->masterFd, POLLIN, 0};
+        if (left <= 0 || poll(&p, 1, left) <= 0)
+            return nullptr;
+        char buffer[4096];
+        ssize_t n = read(sh->masterFd, buffer, sizeof(buffer));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+            return nullptr;
+        if (n > 0)
+            seen.append(buffer, (size_t)n);
+    }
+    return sh;
 }
-void multiWatchThreaded_using_pipes(const vector<string> &cmds, int tab_index, const vector<string> &oldBuffer)
 
+// Send `cmd` to the tab's shell; the reply is streamed like any other job.
+static bool startShellCommand(const string &cmd, TabState &T, vector<string> &out)
 {
-    if (cmds.empty())
-        return;
-    if (tab_index < 0 || tab_index >= (int)tabs.size())
-        return;
-
-    TabState &T = tabs[tab_index];
-
-    // Save old screen buffer for restore
-
-    T.screenBuffer.clear();
-    T.screenBuffer.push_back("multiWatch — starting...");
-    mw_stop_requested.store(false);
-    mw_finished.store(false);
-    cmd_running.store(true);
-
-    while (!mw_stop_requested.load())
+    out.clear();
+    if (trimBlanks(cmd).empty())
     {
-        vector<thread> workers;
-        vector<pair<string, string>> results;
-        mutex results_mtx;
-
-        for (const auto &cmd : cmds)
+        out = {""};
+        return false;
+    }
+    string script = cmd + "\n";
+    size_t off = 0;
+    while (off < script.size())
+    {
+        ssize_t w = write(T.shell->masterFd, script.data() + off, script.size() - off);
+        if (w > 0)
+            off += (size_t)w;
+        else if (w < 0 && errno == EAGAIN)
+            poll(nullptr, 0, 1);
+        else
         {
-            workers.emplace_back([&, cmd]()
-                                 {
-                int pipefd[2];
-                if (pipe(pipefd) < 0) return;
-
-                pid_t pid = fork();
-                if (pid == 0)
-                {
-                    // Child: redirect stdout/stderr to pipe
-                    close(pipefd[0]);
-                    dup2(pipefd[1], STDOUT_FILENO);
-                    dup2(pipefd[1], STDERR_FILENO);
-                    execlp("bash", "bash", "-c", cmd.c_str(), (char*)NULL);
-                    _exit(127);
-                }
-                else if (pid > 0)
-                {
-                    // Parent
-                    close(pipefd[1]);
-                    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
-
-                    // Register PID
-                    {
-                        lock_guard<mutex> lk(current_pids_mutex);
-                        current_child_pids.push_back(pid);
-                    }
-
-                    string outBuf;
-                    char buf[4096];
-                    struct pollfd pfd{pipefd[0], POLLIN | POLLHUP | POLLERR, 0};
-                    bool done = false;
+            out = {"ERROR: shell is gone"};
+            T.shell.reset();
+            return false;
+        }
+    }
 
-                    while (!done && !mw_stop_requested.load())
-                    {
-                        handle_pending_sigint();
-
-                        int r = poll(&pfd, 1, 200);
-                        if (r > 0)
-                        {
-                            if (pfd.revents & POLLIN)
-                            {
-                                ssize_t n = read(pipefd[0], buf, sizeof(buf));
-                                if (n > 0)
-                                    outBuf.append(buf, n);
-                                else if (n == 0)
-                                    done = true;
-                            }
-                            else if (pfd.revents & (POLLHUP | POLLERR))
-                            {
-                                done = true;
-                            }
-                        }
-                    }
+    auto job = make_shared<Job>();
+    job->viaShell = true;
+    job->outFd = T.shell->masterFd;
+    T.job = job;
+    return true;
+}
 
-                    // Stop or wait
-                    int status = 0;
-                    if (mw_stop_requested.load())
-                    {
-                        kill(pid, SIGINT);
-                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                        kill(pid, SIGKILL);
-                    }
-                    waitpid(pid, &status, 0);
-                    close(pipefd[0]);
+// pumpJob() for shell-backed jobs: everything arrives on the pty master and
+// the job ends at the sentinel line rather than at EOF.
+static bool pumpShell(TabState &T)
+{
+    Job &job = *T.job;
+    char buffer[65536];
+    ssize_t n = read(job.outFd, buffer, sizeof(buffer));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return false;
+    if (n <= 0)
+    {
+        // EIO on the master: the shell itself exited
+        if (!job.outPartial.empty())
+            T.screenBuffer.push_back(job.outPartial);
+        T.screenBuffer.push_back("ERROR: (shell exited, back to one process per command)");
+        job.outFd = -1;
+        T.job.reset();
+        T.shell.reset();
+        return true;
+    }
 
-                    // Remove PID record
-                    {
-                        lock_guard<mutex> lk(current_pids_mutex);
-                        auto it = std::find(current_child_pids.begin(), current_child_pids.end(), pid);
-                        if (it != current_child_pids.end())
-                            current_child_pids.erase(it);
-                    }
+    job.outPartial.append(buffer, (size_t)n);
+    size_t pos = 0, nl;
+    while ((nl = job.outPartial.find('\n', pos)) != string::npos)
+    {
+        string line = job.outPartial.substr(pos, nl - pos);
+        pos = nl + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
 
-                    // Save result
-                    lock_guard<mutex> lk(results_mtx);
-                    results.emplace_back(cmd, outBuf.empty() ? "(no output)\n" : outBuf);
-                } });
+        size_t mark = line.find(T.shell->token);
+        if (mark == string::npos)
+        {
+            T.screenBuffer.push_back(line);
+            job.anyOutput = true;
+            continue;
         }
 
-        for (auto &t : workers)
-            if (t.joinable())
-                t.join();
-
-        // Update output like "watch"
+        // "<output without newline><token> <status> <cwd>"
+        if (mark > 0)
         {
-            T.screenBuffer.clear();
-            T.screenBuffer.push_back("multiWatch — " + getCurrentTime() + " (Ctrl+C to stop)");
-            T.screenBuffer.push_back("====================================================");
-
-            for (auto &[cmd, out] : results)
-            {
-                T.screenBuffer.push_back("\"" + cmd + "\" output:");
-                T.screenBuffer.push_back("----------------------------------------------------");
-                std::stringstream ss(out);
-                std::string line;
-                while (std::getline(ss, line))
-                    T.screenBuffer.push_back(line);
-                T.screenBuffer.push_back("----------------------------------------------------");
-            }
+            T.screenBuffer.push_back(line.substr(0, mark));
+            job.anyOutput = true;
         }
-
-        // Refresh every 2s (with frequent stop checks)
-        for (int i = 0; i < 20 && !mw_stop_requested.load(); ++i)
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        istringstream rest(line.substr(mark + T.shell->token.size()));
+        int status = 0;
+        rest >> status;
+        string cwd;
+        getline(rest >> ws, cwd);
+        if (!cwd.empty() && cwd != T.cwd)
+        {
+            T.cwd = cwd;
+            prefetchDirectories(cwd);
+        }
+        if (status != 0 && !job.anyOutput)
+            T.screenBuffer.push_back("ERROR: (process exited with code " + to_string(status) + ")");
+        job.outFd = -1;
+        T.job.reset();
+        return true;
     }
+    job.outPartial.erase(0, pos);
+    return false;
+}
 
-    // Cleanup any leftover child processes
+// Ctrl+C for a tab with a running command
+static void interruptJob(TabState &T)
+{
+    if (!T.job)
+        return;
+    if (T.job->viaShell)
     {
-        lock_guard<mutex> lk(current_pids_mutex);
-        for (pid_t p : current_child_pids)
-            if (p > 0)
-                kill(p, SIGINT);
-        current_child_pids.clear();
+        // let the pty's line discipline signal the foreground process group
+        char intr = 0x03;
+        ssize_t r = write(T.job->outFd, &intr, 1);
+        (void)r;
+        return;
     }
+    for (pid_t p : T.job->pids)
+        kill(p, SIGINT);
+}
 
-    // Restore previous screen 
-    T.screenBuffer = oldBuffer;
-    // T.screenBuffer.push_back("^C");
-
-    std::string sdisp = formatPWD(T.cwd);
-  
+// multiWatch: every watched command is a task on a long-lived worker pool.
+// A task runs its command once, publishes the output to its session and
+// schedules itself again, so commands run on their own cycles and a slow
+// one never holds up the rest.
+//
+// Schedules live on a hashed timer wheel: WHEEL_SLOTS buckets of
+// WHEEL_TICK_MS each, a task WHEEL_SLOTS or more ticks out also counting
+// the full turns it still has to wait. A ticker thread advances the wheel
+// and hands due tasks to the workers. Each run is scheduled its period
+// after the previous one finished, give or take WATCH_JITTER_PCT, and the
+// first runs are spread evenly over each command's interval, so commands
+// stay apart instead of forking together. A command that takes longer
+// than its current period has the period doubled (up to WATCH_BACKOFF_MAX
+// times its interval), and halved back once it runs within the interval.
+static const int WATCH_INTERVAL_MS = 2000;
+static const int WATCH_MIN_INTERVAL_MS = 100;
+static const int WATCH_JITTER_PCT = 10;
+static const int WATCH_BACKOFF_MAX = 16;
+static const int WHEEL_TICK_MS = 10;
+static const size_t WHEEL_SLOTS = 512;
+
+struct WatchCommand
+{
+    string cmd;
+    int intervalMs = WATCH_INTERVAL_MS;
+    bool onChange = false; // multiWatch --on: rerun on file changes, not on a timer
+};
+
+// One command's block on the multiWatch screen, with the output lines that
+// differ from the previous run marked. Immutable once published: a frame
+// whose command did not change reuses the block from the frame before.
+struct WatchSection
+{
+    vector<string> lines;
+    vector<char> changed; // per line of `lines`
+};
 
-    T.input.clear();
-    T.currCursorPos = 0;
+struct WatchFrame
+{
+    vector<shared_ptr<const WatchSection>> sections; // one per command
+};
+
+// One multiWatch run, owned by its tab (TabState::watch) and shared with
+// the tasks on the pool. Workers never touch the tab: after a run whose
+// output differs from the last one (compared by per-line hashes), they
+// replace that command's section and swap a new frame in with
+// atomic_store; the UI loop atomic_loads the latest one when woken. A run
+// with the same output publishes nothing, so a steady screen costs no
+// allocations and no redraws.
+struct WatchSession
+{
+    vector<WatchCommand> cmds;
+    string cwd; // the tab's, when the session started
+    atomic<bool> stopping{false};
+    mutex mtx;
+    vector<vector<size_t>> hashes;                   // guarded by mtx: last output, per line
+    vector<shared_ptr<const WatchSection>> sections; // guarded by mtx
+    vector<int> periodMs;                            // guarded by mtx: interval after backoff
+    vector<int> shownPeriodMs;                       // guarded by mtx: period in the section header
+    vector<string> changedAt;                        // guarded by mtx: time output last changed
+    vector<char> busy;                               // guarded by mtx: --on task queued or running
+    vector<char> rerun;                              // guarded by mtx: --on change while busy
+    shared_ptr<const WatchFrame> frame;              // atomic_load/atomic_store only
+};
+
+struct WatchTask
+{
+    shared_ptr<WatchSession> session;
+    size_t idx = 0;
+    size_t rounds = 0; // full turns of the wheel still to wait
+};
 
-    // Reset state flags so the next command works
-    cmd_running.store(false);
-    mw_finished.store(true);
-    mw_stop_requested.store(false);
-    sigint_request_flag = 0; //
+struct WatchPool
+{
+    mutex mtx;
+    condition_variable readyCv; // workers: ready is non-empty
+    condition_variable tickCv;  // ticker: something was scheduled
+    vector<vector<WatchTask>> wheel = vector<vector<WatchTask>>(WHEEL_SLOTS); // guarded by mtx
+    size_t cursor = 0;                   // guarded by mtx: slot of tickAt
+    chrono::steady_clock::time_point tickAt; // guarded by mtx
+    size_t scheduled = 0;                // guarded by mtx: tasks on the wheel
+    deque<WatchTask> ready;              // guarded by mtx: due, waiting for a worker
+    chrono::steady_clock::time_point sleepUntil = chrono::steady_clock::time_point::max(); // guarded by mtx: ticker's wakeup
+};
+// never freed: the workers live as long as the process
+static WatchPool &watchPool = *new WatchPool;
+
+// put `task` on the wheel `delayMs` from now; caller holds watchPool.mtx
+static void scheduleWatchTask(WatchTask task, int delayMs)
+{
+    auto now = chrono::steady_clock::now();
+    if (watchPool.scheduled == 0)
+        watchPool.tickAt = now; // wheel was idle: restart its clock here
+    auto ahead = now + chrono::milliseconds(delayMs) - watchPool.tickAt;
+    size_t ticks = max<long long>(1, (chrono::duration_cast<chrono::milliseconds>(ahead).count() + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS);
+    task.rounds = (ticks - 1) / WHEEL_SLOTS;
+    watchPool.wheel[(watchPool.cursor + ticks) % WHEEL_SLOTS].push_back(move(task));
+    watchPool.scheduled++;
+    // due before the ticker means to wake up: wake it now
+    if (watchPool.tickAt + chrono::milliseconds(ticks * WHEEL_TICK_MS) < watchPool.sleepUntil)
+        watchPool.tickCv.notify_one();
 }
 
-
-vector<string> execCommand(const string &cmd)
+static int jittered(int ms)
 {
-    if (cmd.empty())
-        return {""};
-
-    // Trim helper
-    auto trim_inplace = [](string &s)
-    {
-        s.erase(0, s.find_first_not_of(" \t"));
-        if (!s.empty())
-            s.erase(s.find_last_not_of(" \t") + 1);
-    };
+    static thread_local minstd_rand rng(random_device{}());
+    int spread = ms * WATCH_JITTER_PCT / 100;
+    return spread > 0 ? ms + (int)(rng() % (2 * spread + 1)) - spread : ms;
+}
 
-    string cmdcopy = cmd;
-    trim_inplace(cmdcopy);
-    if (cmdcopy.empty())
-        return {""};
+// ticks from the cursor to the first task that is due; caller holds
+// watchPool.mtx and the wheel is not empty
+static size_t ticksToNextDue()
+{
+    size_t best = SIZE_MAX;
+    for (size_t d = 1; d <= WHEEL_SLOTS; ++d)
+        for (auto &task : watchPool.wheel[(watchPool.cursor + d) % WHEEL_SLOTS])
+            best = min(best, d + task.rounds * WHEEL_SLOTS);
+    return best;
+}
 
-    // built-in cd handling
-    if (cmdcopy.rfind("cd ", 0) == 0)
+// Sleeps until the earliest task is due, not tick by tick, then catches
+// the wheel up over every tick that passed in between.
+static void watchTicker()
+{
+    unique_lock<mutex> lk(watchPool.mtx);
+    for (;;)
     {
-        string path = cmdcopy.substr(3);
-        trim_inplace(path);
-        if (path.empty() || path == "~")
+        auto now = chrono::steady_clock::now();
+        size_t before = watchPool.ready.size();
+        while (watchPool.scheduled > 0 && watchPool.tickAt + chrono::milliseconds(WHEEL_TICK_MS) <= now)
         {
-            const char *home = getenv("HOME");
-            if (home)
-                chdir(home);
-            return {""};
+            watchPool.tickAt += chrono::milliseconds(WHEEL_TICK_MS);
+            watchPool.cursor = (watchPool.cursor + 1) % WHEEL_SLOTS;
+            auto &slot = watchPool.wheel[watchPool.cursor];
+            for (size_t i = 0; i < slot.size();)
+            {
+                if (slot[i].rounds > 0)
+                {
+                    slot[i++].rounds--;
+                    continue;
+                }
+                watchPool.ready.push_back(move(slot[i]));
+                slot[i] = move(slot.back());
+                slot.pop_back();
+                watchPool.scheduled--;
+            }
         }
-        if (chdir(path.c_str()) != 0)
-            return {string("ERROR: cd: no such file or directory: ") + path};
-        return {""};
-    }
-    if (cmdcopy == "cd" || cmdcopy == "cd ~")
-    {
-        const char *home = getenv("HOME");
-        if (home)
-            chdir(home);
-        return {""};
-    }
+        for (size_t i = before; i < watchPool.ready.size(); ++i)
+            watchPool.readyCv.notify_one();
 
-    // Split pipeline by '|'
-    vector<string> parts;
-    {
-        stringstream ss(cmd);
-        string p;
-        while (getline(ss, p, '|'))
+        if (watchPool.scheduled == 0)
         {
-            trim_inplace(p);
-            if (!p.empty())
-                parts.push_back(p);
+            watchPool.sleepUntil = chrono::steady_clock::time_point::max();
+            watchPool.tickCv.wait(lk);
+            continue;
         }
+        watchPool.sleepUntil = watchPool.tickAt + chrono::milliseconds(ticksToNextDue() * WHEEL_TICK_MS);
+        watchPool.tickCv.wait_until(lk, watchPool.sleepUntil);
     }
-    if (parts.empty())
-        return {""};
+}
 
-    int n = (int)parts.size();
-    int numPipes = max(0, n - 1);
+// run `cmd` once in `cwd`, stdout and stderr together; gives up when
+// `stop` is set
+static string runWatchCommand(const string &cmd, const string &cwd, const atomic<bool> &stop)
+{
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) < 0)
+        return "ERROR: pipe: " + string(strerror(errno)) + "\n";
+
+    SpawnSpec spec;
+    spec.argv = {"bash", "-c", cmd};
+    spec.cwd = cwd;
+    spec.dups = {{pipefd[1], STDOUT_FILENO}, {pipefd[1], STDERR_FILENO}};
+    pid_t pid = spawnProcess(spec);
+    close(pipefd[1]);
+    if (pid < 0)
+    {
+        close(pipefd[0]);
+        return "ERROR: cannot start command: " + string(strerror(errno)) + "\n";
+    }
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
 
-    // allocate pipes for chaining
-    vector<int> chainFds(2 * numPipes, -1);
-    for (int i = 0; i < numPipes; ++i)
+    string outBuf;
+    char buf[4096];
+    struct pollfd pfd{pipefd[0], POLLIN | POLLHUP | POLLERR, 0};
+    bool done = false;
+    while (!done && !stop.load())
     {
-        if (pipe(chainFds.data() + i * 2) < 0)
+        int r = poll(&pfd, 1, 200);
+        if (r > 0)
         {
-            // cleanup
-            for (int j = 0; j < i; ++j)
+            if (pfd.revents & POLLIN)
             {
-                close(chainFds[j * 2]);
-                close(chainFds[j * 2 + 1]);
+                ssize_t n = read(pipefd[0], buf, sizeof(buf));
+                if (n > 0)
+                    outBuf.append(buf, n);
+                else if (n == 0)
+                    done = true;
             }
-            return {"ERROR: pipe creation failed"};
+            else if (pfd.revents & (POLLHUP | POLLERR))
+                done = true;
         }
     }
 
-    int capture_out[2] = {-1, -1}, capture_err[2] = {-1, -1};
-    if (pipe(capture_out) < 0)
+    int status = 0;
+    if (!done)
     {
-        for (int fd : chainFds)
-            if (fd >= 0)
-                close(fd);
-        return {"ERROR: capture_out pipe failed"};
-    }
-    if (pipe(capture_err) < 0)
-    {
-        close(capture_out[0]);
-        close(capture_out[1]);
-        for (int fd : chainFds)
-            if (fd >= 0)
-                close(fd);
-        return {"ERROR: capture_err pipe failed"};
+        kill(pid, SIGINT);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        kill(pid, SIGKILL);
     }
+    waitpid(pid, &status, 0);
+    close(pipefd[0]);
+    return outBuf.empty() ? "(no output)\n" : outBuf;
+}
 
-    vector<pid_t> pids;
-    bool forkError = false;
+static string formatInterval(int ms)
+{
+    return ms % 1000 == 0 ? to_string(ms / 1000) + "s" : to_string(ms) + "ms";
+}
+
+static const vector<string> WATCH_TOP = {"multiWatch (Ctrl+C to stop)",
+                                          "===================================================="};
+
+static shared_ptr<const WatchSection> renderSection(const WatchCommand &wc, int period, const string &when,
+                                                    const vector<string> &out, const vector<char> &changed)
+{
+    auto sec = make_shared<WatchSection>();
+    string every = wc.intervalMs == WATCH_INTERVAL_MS ? "" : " (every " + formatInterval(wc.intervalMs) + ")";
+    if (period > wc.intervalMs)
+        every = " (slow: every " + formatInterval(period) + ")";
+    if (wc.onChange)
+        every = " (on change)";
+    sec->lines.push_back("\"" + wc.cmd + "\" output" + every + (when.empty() ? "" : ", changed " + when) + ":");
+    sec->lines.push_back("----------------------------------------------------");
+    sec->lines.insert(sec->lines.end(), out.begin(), out.end());
+    sec->lines.push_back("----------------------------------------------------");
+    sec->changed.assign(2, 0);
+    sec->changed.insert(sec->changed.end(), changed.begin(), changed.end());
+    sec->changed.push_back(0);
+    return sec;
+}
 
-    cmd_running.store(true);
+// Compare a run's output with the command's previous one and, if anything
+// differs (or the last run's marks still need clearing), put a new section
+// and frame up. Caller holds S.mtx.
+static bool updateWatchSection(WatchSession &S, size_t idx, const string &out)
+{
+    vector<string> lines;
+    vector<size_t> hashes;
+    size_t from = 0;
+    while (from < out.size())
     {
-        lock_guard<mutex> lk(current_pids_mutex);
-        current_child_pids.clear();
+        size_t nl = out.find('\n', from);
+        if (nl == string::npos)
+            nl = out.size();
+        lines.push_back(out.substr(from, nl - from));
+        hashes.push_back(std::hash<string>()(lines.back()));
+        from = nl + 1;
     }
 
-    for (int i = 0; i < n; ++i)
+    const vector<size_t> &old = S.hashes[idx];
+    bool first = old.empty(); // nothing to compare with: no marks
+    vector<char> changed(lines.size());
+    bool any = lines.size() != old.size();
+    for (size_t i = 0; i < lines.size(); ++i)
+        any |= changed[i] = !first && (i >= old.size() || old[i] != hashes[i]);
+    const vector<char> &marks = S.sections[idx]->changed;
+    bool marked = find(marks.begin(), marks.end(), 1) != marks.end();
+    if (!any && !marked && S.periodMs[idx] == S.shownPeriodMs[idx])
+        return false;
+
+    if (any)
+        S.changedAt[idx] = getCurrentTime().substr(11);
+    S.shownPeriodMs[idx] = S.periodMs[idx];
+    S.sections[idx] = renderSection(S.cmds[idx], S.periodMs[idx], S.changedAt[idx], lines, changed);
+    S.hashes[idx] = move(hashes);
+
+    auto frame = make_shared<WatchFrame>();
+    frame->sections = S.sections;
+    // under S.mtx, so a slower publish cannot replace a newer one
+    atomic_store(&S.frame, shared_ptr<const WatchFrame>(move(frame)));
+    return true;
+}
+
+static void watchWorker()
+{
+    unique_lock<mutex> lk(watchPool.mtx);
+    for (;;)
     {
-        pid_t pid = fork();
-        if (pid < 0)
+        watchPool.readyCv.wait(lk, []
+                               { return !watchPool.ready.empty(); });
+        WatchTask task = move(watchPool.ready.front());
+        watchPool.ready.pop_front();
+        WatchSession &S = *task.session;
+        const WatchCommand &wc = S.cmds[task.idx];
+        lk.unlock();
+
+        auto began = chrono::steady_clock::now();
+        string out = runWatchCommand(wc.cmd, S.cwd, S.stopping);
+        int tookMs = (int)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - began).count();
+
+        lk.lock();
         {
-            forkError = true;
-            break;
-        }
-        if (pid == 0)
-        {
-            // Child
-            if (i > 0)
-                dup2(chainFds[(i - 1) * 2], STDIN_FILENO);
-            if (i < numPipes)
-                dup2(chainFds[i * 2 + 1], STDOUT_FILENO);
+            lock_guard<mutex> slk(S.mtx);
+            // checked under the pool lock, so stopWatchSession() either
+            // sees this entry to remove or we see its flag
+            if (S.stopping)
+                continue;
+            if (wc.onChange)
+            {
+                // files changed again while this ran: its output may be stale
+                if (S.rerun[task.idx])
+                    scheduleWatchTask(task, 0);
+                S.busy[task.idx] = S.rerun[task.idx];
+                S.rerun[task.idx] = 0;
+            }
             else
-                dup2(capture_out[1], STDOUT_FILENO);
-
-            // send stderr to capture_err
-            dup2(capture_err[1], STDERR_FILENO);
-
-            // close all fds inherited
-            for (int fd : chainFds)
-                if (fd >= 0)
-                    close(fd);
-            close(capture_out[0]);
-            close(capture_out[1]);
-            close(capture_err[0]);
-            close(capture_err[1]);
-
-            execlp("bash", "bash", "-c", parts[i].c_str(), (char *)NULL);
-            _exit(127);
-        }
-        else
-        {
-            pids.push_back(pid);
+            {
+                int &period = S.periodMs[task.idx];
+                if (tookMs > period)
+                    period = min(max(2 * period, tookMs), WATCH_BACKOFF_MAX * wc.intervalMs);
+                else if (tookMs <= wc.intervalMs && period > wc.intervalMs)
+                    period = max(wc.intervalMs, period / 2);
+                scheduleWatchTask(task, jittered(period));
+            }
+            if (!updateWatchSection(S, task.idx, out))
+                continue;
         }
+        wake_ui();
     }
+}
 
-    if (forkError)
-    {
-        for (int fd : chainFds)
-            if (fd >= 0)
-                close(fd);
-        close(capture_out[0]);
-        close(capture_out[1]);
-        close(capture_err[0]);
-        close(capture_err[1]);
-        for (pid_t p : pids)
-            if (p > 0)
-                waitpid(p, nullptr, 0);
-        cmd_running.store(false);
-        return {"ERROR: fork failed"};
-    }
+static void startWatchPool()
+{
+    static once_flag started;
+    call_once(started, []
+              {
+        thread(watchTicker).detach();
+        unsigned n = clamp(2 * thread::hardware_concurrency(), 8u, 32u);
+        for (unsigned i = 0; i < n; ++i)
+            thread(watchWorker).detach(); });
+}
 
-    // parent closes all chain write-ends and read-ends that it doesn't need
-    for (int fd : chainFds)
-        if (fd >= 0)
-            close(fd);
-    close(capture_out[1]);
-    close(capture_err[1]);
+// multiWatch --on: one inotify instance shared by all sessions. A file is
+// watched through its parent directory (filtered by name), so editors that
+// save by renaming and logs that get rotated keep being seen; a directory
+// is watched itself, not recursively. Events are debounced per session:
+// its commands rerun once WATCH_DEBOUNCE_MS pass without a new event, or
+// WATCH_DEBOUNCE_MAX_MS after the first, if the events never stop.
+static const int WATCH_DEBOUNCE_MS = 200;
+static const int WATCH_DEBOUNCE_MAX_MS = 2000;
+static const uint32_t WATCH_EVENTS = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                     IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+struct WatchTarget
+{
+    shared_ptr<WatchSession> session;
+    string name; // entry of the watched directory, empty for any
+};
 
-    // record pids for UI interrupts
+struct WatchNotifier
+{
+    mutex mtx;
+    int fd = -1;
+    unordered_map<int, vector<WatchTarget>> targets; // guarded by mtx, by watch descriptor
+};
+// never freed: the notifier thread lives as long as the process
+static WatchNotifier &watchNotifier = *new WatchNotifier;
+
+// rerun every command of an --on session; one already queued or running
+// runs once more after it finishes
+static void triggerWatch(const shared_ptr<WatchSession> &session)
+{
+    lock_guard<mutex> lk(watchPool.mtx);
+    lock_guard<mutex> slk(session->mtx);
+    if (session->stopping)
+        return;
+    for (size_t i = 0; i < session->cmds.size(); ++i)
     {
-        lock_guard<mutex> lk(current_pids_mutex);
-        current_child_pids = pids;
+        if (session->busy[i])
+        {
+            session->rerun[i] = 1;
+            continue;
+        }
+        session->busy[i] = 1;
+        WatchTask task;
+        task.session = session;
+        task.idx = i;
+        scheduleWatchTask(task, 0);
     }
+}
 
-    // read both pipes
-    string outBuf, errBuf;
-    const int BUF_SZ = 4096;
-    char buffer[BUF_SZ];
-    struct pollfd pfds[2];
-    pfds[0].fd = capture_out[0];
-    pfds[0].events = POLLIN | POLLHUP | POLLERR;
-    pfds[1].fd = capture_err[0];
-    pfds[1].events = POLLIN | POLLHUP | POLLERR;
-
-    int active = 2;
-    while (active > 0)
+static void watchNotifierLoop()
+{
+    using clock = chrono::steady_clock;
+    struct Pending
     {
-        handle_pending_sigint();
-
-        int r = poll(pfds, 2, -1);
-        if (r < 0)
+        clock::time_point first, last;
+    };
+    map<shared_ptr<WatchSession>, Pending> pending;
+    alignas(struct inotify_event) char buf[16384];
+    for (;;)
+    {
+        int timeout = -1;
+        auto now = clock::now();
+        for (auto &[session, p] : pending)
         {
-            if (errno == EINTR)
-            {
-                handle_pending_sigint();
-                continue;
-            }
-            break;
+            auto due = min(p.last + chrono::milliseconds(WATCH_DEBOUNCE_MS),
+                           p.first + chrono::milliseconds(WATCH_DEBOUNCE_MAX_MS));
+            int ms = (int)max<long long>(0, chrono::duration_cast<chrono::milliseconds>(due - now).count() + 1);
+            timeout = timeout < 0 ? ms : min(timeout, ms);
         }
-        for (int i = 0; i < 2; ++i)
+        struct pollfd pfd{watchNotifier.fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+            return;
+
+        ssize_t n;
+        while ((n = read(watchNotifier.fd, buf, sizeof(buf))) > 0)
         {
-            if (pfds[i].fd < 0)
-                continue;
-            if (pfds[i].revents & POLLIN)
+            now = clock::now();
+            lock_guard<mutex> lk(watchNotifier.mtx);
+            for (char *at = buf; at < buf + n;)
             {
-                ssize_t n = read(pfds[i].fd, buffer, BUF_SZ);
-                if (n > 0)
-                {
-                    if (i == 0)
-                        outBuf.append(buffer, n);
-                    else
-                        errBuf.append(buffer, n);
-                }
-                else
-                {
-                    close(pfds[i].fd);
-                    pfds[i].fd = -1;
-                    active--;
-                }
-            }
-            else if (pfds[i].revents & (POLLHUP | POLLERR))
-            {
-                // drain
-                while (true)
-                {
-                    ssize_t n = read(pfds[i].fd, buffer, BUF_SZ);
-                    if (n > 0)
+                auto *ev = reinterpret_cast<struct inotify_event *>(at);
+                at += sizeof(struct inotify_event) + ev->len;
+                for (auto &[wd, list] : watchNotifier.targets)
+                    for (auto &t : list)
                     {
-                        if (i == 0)
-                            outBuf.append(buffer, n);
+                        // overflow: events were lost, so treat it as a change everywhere
+                        bool hit = (ev->mask & IN_Q_OVERFLOW) ||
+                                   (wd == ev->wd && (t.name.empty() || (ev->len && t.name == ev->name)));
+                        if (!hit)
+                            continue;
+                        auto it = pending.find(t.session);
+                        if (it == pending.end())
+                            pending[t.session] = Pending{now, now};
                         else
-                            errBuf.append(buffer, n);
+                            it->second.last = now;
                     }
-                    else
-                        break;
-                }
-                if (pfds[i].fd >= 0)
-                {
-                    close(pfds[i].fd);
-                    pfds[i].fd = -1;
-                    active--;
-                }
             }
         }
-    }
 
-    if (pfds[0].fd >= 0)
-    {
-        close(pfds[0].fd);
-        pfds[0].fd = -1;
-    }
-    if (pfds[1].fd >= 0)
-    {
-        close(pfds[1].fd);
-        pfds[1].fd = -1;
+        now = clock::now();
+        for (auto it = pending.begin(); it != pending.end();)
+        {
+            auto &p = it->second;
+            if (now - p.last >= chrono::milliseconds(WATCH_DEBOUNCE_MS) ||
+                now - p.first >= chrono::milliseconds(WATCH_DEBOUNCE_MAX_MS))
+            {
+                triggerWatch(it->first);
+                it = pending.erase(it);
+            }
+            else
+                ++it;
+        }
     }
+}
 
-    // wait children
-    bool hadError = false;
-    int lastStatus = 0;
-    for (pid_t p : pids)
+// Watch `paths` (relative ones against `cwd`) for the session; "" on
+// success, else the error to show.
+static string watchPaths(const shared_ptr<WatchSession> &session, const vector<string> &paths, const string &cwd)
+{
+    static once_flag started;
+    call_once(started, []
+              {
+        watchNotifier.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watchNotifier.fd >= 0)
+            thread(watchNotifierLoop).detach(); });
+    if (watchNotifier.fd < 0)
+        return "ERROR: multiWatch: inotify: " + string(strerror(errno));
+
+    lock_guard<mutex> lk(watchNotifier.mtx);
+    for (auto &path : paths)
     {
-        int status = 0;
-        if (waitpid(p, &status, 0) < 0)
+        string full = path[0] == '/' ? path : (cwd == "/" ? "" : cwd) + "/" + path;
+        struct stat st{};
+        WatchTarget target;
+        target.session = session;
+        string dir = full;
+        if (stat(full.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
         {
-            hadError = true;
+            // a file, or one that does not exist yet: watch its directory
+            while (dir.size() > 1 && dir.back() == '/')
+                dir.pop_back();
+            size_t slash = dir.rfind('/');
+            target.name = dir.substr(slash + 1);
+            dir = slash == 0 ? "/" : dir.substr(0, slash);
         }
-        else
+        int wd = inotify_add_watch(watchNotifier.fd, dir.c_str(), WATCH_EVENTS);
+        if (wd < 0)
+            return "ERROR: multiWatch: cannot watch " + path + ": " + strerror(errno);
+        watchNotifier.targets[wd].push_back(target);
+    }
+    return "";
+}
+
+static void unwatchPaths(const shared_ptr<WatchSession> &session)
+{
+    lock_guard<mutex> lk(watchNotifier.mtx);
+    for (auto it = watchNotifier.targets.begin(); it != watchNotifier.targets.end();)
+    {
+        auto &list = it->second;
+        list.erase(remove_if(list.begin(), list.end(), [&](const WatchTarget &t)
+                             { return t.session == session; }),
+                   list.end());
+        if (!list.empty())
         {
-            lastStatus = status;
-            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
-                hadError = true;
+            ++it;
+            continue;
         }
+        inotify_rm_watch(watchNotifier.fd, it->first);
+        it = watchNotifier.targets.erase(it);
     }
+}
 
-    // clear recorded pids
+// take the session's tasks off the wheel; runs still going see `stopping`,
+// kill their command and drop the result
+static void stopWatchSession(const shared_ptr<WatchSession> &session)
+{
+    session->stopping = true;
+    unwatchPaths(session);
     {
-        lock_guard<mutex> lk(current_pids_mutex);
-        current_child_pids.clear();
+        lock_guard<mutex> lk(watchPool.mtx);
+        auto mine = [&](const WatchTask &t)
+        { return t.session == session; };
+        for (auto &slot : watchPool.wheel)
+        {
+            auto keep = remove_if(slot.begin(), slot.end(), mine);
+            watchPool.scheduled -= slot.end() - keep;
+            slot.erase(keep, slot.end());
+        }
+        watchPool.ready.erase(remove_if(watchPool.ready.begin(), watchPool.ready.end(), mine), watchPool.ready.end());
     }
-    cmd_running.store(false);
-
-    // treat stderr content as error
-    if (!errBuf.empty())
-        hadError = true;
+}
 
-    // split lines helper
-    auto splitLines = [](const string &s) -> vector<string>
+// the list inside multiWatch [...]: quoted commands, each optionally
+// followed by an interval "@<n>[ms|s|m]" (default unit s), e.g.
+// multiWatch ["df -h" @10s, "date", "ls" @500ms]
+static vector<WatchCommand> parseWatchCommands(const string &inside)
+{
+    vector<WatchCommand> cmds;
+    regex r("\"([^\"]+)\"(\\s*@\\s*([0-9]+)\\s*(ms|s|m)?)?");
+    smatch m;
+    string::const_iterator it(inside.cbegin());
+    while (regex_search(it, inside.cend(), m, r))
     {
-        vector<string> out;
-        size_t pos = 0;
-        while (pos < s.size())
+        WatchCommand wc;
+        wc.cmd = m[1];
+        if (m[3].matched)
         {
-            size_t nl = s.find('\n', pos);
-            if (nl == string::npos)
-            {
-                out.push_back(s.substr(pos));
-                break;
-            }
-            out.push_back(s.substr(pos, nl - pos));
-            pos = nl + 1;
+            long n = min(stol(m[3].str().substr(0, 9)), 100000000L);
+            string unit = m[4].matched ? m[4].str() : "s";
+            long ms = unit == "ms" ? n : unit == "m" ? n * 60000 : n * 1000;
+            wc.intervalMs = (int)clamp(ms, (long)WATCH_MIN_INTERVAL_MS, 24L * 3600 * 1000);
         }
-        return out;
-    };
+        cmds.push_back(wc);
+        it = m.suffix().first;
+    }
+    return cmds;
+}
 
-    vector<string> outLines = splitLines(outBuf);
-    vector<string> errLines = splitLines(errBuf);
+// the options between "multiWatch" and "[": any number of "--on <path>"
+// (a path with blanks in double quotes). False on anything else.
+static bool parseWatchPaths(const string &head, vector<string> &paths)
+{
+    istringstream in(head);
+    string opt;
+    while (in >> opt)
+    {
+        string path;
+        if (opt != "--on" || !(in >> quoted(path)) || path.empty())
+            return false;
+        paths.push_back(path);
+    }
+    return true;
+}
 
-    vector<string> result;
-    if (hadError)
+// Start watching `cmds` in tab T: its screen is saved and replaced by the
+// session's snapshots until stopWatch(). With `onPaths` the commands run
+// once, then again each time one of those paths changes. Returns "" or the
+// error to show.
+static string startWatch(TabState &T, vector<WatchCommand> cmds, const vector<string> &onPaths)
+{
+    auto session = make_shared<WatchSession>();
+    for (auto &wc : cmds)
+        wc.onChange = !onPaths.empty();
+    session->cmds = cmds;
+    session->cwd = T.cwd;
+    session->hashes.resize(cmds.size());
+    session->changedAt.resize(cmds.size());
+    session->busy.assign(cmds.size(), 1);
+    session->rerun.resize(cmds.size());
+    if (!onPaths.empty())
     {
-        if (!errLines.empty())
+        string err = watchPaths(session, onPaths, T.cwd);
+        if (!err.empty())
         {
-            for (auto &l : errLines)
-                result.push_back(string("ERROR: ") + l);
+            unwatchPaths(session);
+            return err;
         }
-        else if (!outLines.empty())
-        {
-            for (auto &l : outLines)
-                result.push_back(string("ERROR: ") + l);
-        }
-        else
+    }
+    for (auto &wc : cmds)
+    {
+        session->periodMs.push_back(wc.intervalMs);
+        session->shownPeriodMs.push_back(wc.intervalMs);
+        session->sections.push_back(renderSection(wc, wc.intervalMs, "", {"(waiting for first run...)"}, {0}));
+    }
+    startWatchPool();
+    {
+        lock_guard<mutex> lk(watchPool.mtx);
+        for (size_t i = 0; i < cmds.size(); ++i)
         {
-            int exitCode = (WIFEXITED(lastStatus) ? WEXITSTATUS(lastStatus) : -1);
-            result.push_back(string("ERROR: (process exited with code ") + to_string(exitCode) + ")");
+            WatchTask task;
+            task.session = session;
+            task.idx = i;
+            scheduleWatchTask(task, cmds[i].onChange ? 0 : (int)((long long)i * cmds[i].intervalMs / cmds.size()));
         }
     }
+
+    T.watch = session;
+    T.watchShown.reset();
+    T.watchSaved = move(T.screenBuffer);
+    T.screenBuffer = {"multiWatch — starting..."};
+    T.lineMarks.clear();
+    invalidateWrap(T);
+    return "";
+}
+
+// take the latest frame if the workers published one since; true if the
+// screen changed. Lines of the leading sections that are the same objects
+// as on screen are kept, along with their wrap rows.
+static bool adoptWatchSnapshot(TabState &T)
+{
+    if (!T.watch)
+        return false;
+    auto frame = atomic_load(&T.watch->frame);
+    if (!frame || frame == T.watchShown)
+        return false;
+
+    size_t keep = 0, line = WATCH_TOP.size();
+    if (T.watchShown)
+        while (keep < frame->sections.size() && frame->sections[keep] == T.watchShown->sections[keep])
+            line += frame->sections[keep++]->lines.size();
     else
+        T.screenBuffer = WATCH_TOP;
+    T.screenBuffer.resize(line);
+    T.lineMarks.resize(line);
+    for (size_t i = keep; i < frame->sections.size(); ++i)
     {
-        result = std::move(outLines);
-        if (result.empty())
-            result.push_back("");
+        const WatchSection &sec = *frame->sections[i];
+        T.screenBuffer.insert(T.screenBuffer.end(), sec.lines.begin(), sec.lines.end());
+        T.lineMarks.insert(T.lineMarks.end(), sec.changed.begin(), sec.changed.end());
     }
-
-    return result;
+    invalidateWrap(T, line);
+    T.watchShown = frame;
+    return true;
 }
 
+// Ctrl+C or closing the tab: stop the session and put the old screen back
+static void stopWatch(TabState &T)
+{
+    if (!T.watch)
+        return;
+    stopWatchSession(T.watch);
+    T.watch.reset();
+    T.watchShown.reset();
+    T.screenBuffer = move(T.watchSaved);
+    T.watchSaved.clear();
+    T.lineMarks.clear();
+    invalidateWrap(T);
+}
@@ -21,9 +21,12 @@
 #include <regex>
 #include <sys/stat.h>
 #include <limits.h>
+#include <sys/mman.h>
+#include <sys/file.h>
 using namespace std;
 
-const string FILENAME = "./history.txt";
+const string FILENAME = "./history.txt"; // text import / export (history -w)
+const string HISTORY_BIN = "./history.bin";
 
 int commonPrefixLength(const string &a, const string &b)
 {
@@ -33,107 +36,834 @@ int commonPrefixLength(const string &a, const string &b)
             return i;
     return len;
 }
-int getLastHistoryNumber()
+// Ctrl+R index over the history entries (ids are positions in `inputs`).
+// Every entry is indexed by its distinct lowercase trigrams, so a substring
+// query only verifies entries that contain all of the query's trigrams,
+// newest first. Each entry also gets a 64-bit mask of the characters it
+// contains; queries shorter than three characters and the fuzzy
+// (subsequence) fallback scan the masks and verify only the survivors.
+// blockMasks ORs the masks of 64 consecutive entries so blocks that cannot
+// match are skipped whole.
+const int HISTORY_BLOCK = 64;
+
+struct HistoryIndex
 {
-    ifstream in(FILENAME);
-    if (!in)
-        return 0;
+    unordered_map<uint32_t, vector<uint32_t>> postings;
+    vector<uint64_t> masks;
+    vector<uint64_t> blockMasks;
+};
+static HistoryIndex histIndex;
 
-    string line; int lastNum = 0;
-    while (getline(in, line))
+static inline unsigned char foldChar(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+}
+
+static inline uint64_t charBit(unsigned char c)
+{
+    c = foldChar(c);
+    if (c >= 'a' && c <= 'z')
+        return 1ULL << (c - 'a');
+    if (c >= '0' && c <= '9')
+        return 1ULL << (26 + c - '0');
+    return 1ULL << (36 + c % 28);
+}
+
+static uint64_t charMask(string_view s)
+{
+    uint64_t m = 0;
+    for (unsigned char c : s)
+        m |= charBit(c);
+    return m;
+}
+
+static void indexHistoryEntry(string_view cmd)
+{
+    uint32_t id = (uint32_t)histIndex.masks.size();
+    uint64_t mask = charMask(cmd);
+    histIndex.masks.push_back(mask);
+    if (id % HISTORY_BLOCK == 0)
+        histIndex.blockMasks.push_back(0);
+    histIndex.blockMasks.back() |= mask;
+    vector<uint32_t> grams;
+    for (size_t i = 0; i + 3 <= cmd.size(); ++i)
+        grams.push_back((uint32_t)foldChar(cmd[i]) << 16 | (uint32_t)foldChar(cmd[i + 1]) << 8 | foldChar(cmd[i + 2]));
+    sort(grams.begin(), grams.end());
+    grams.erase(unique(grams.begin(), grams.end()), grams.end());
+    for (uint32_t g : grams)
+        histIndex.postings[g].push_back(id);
+}
+
+static void buildHistoryIndex(const vector<string_view> &history)
+{
+    histIndex = HistoryIndex();
+    histIndex.masks.reserve(history.size());
+    for (auto &cmd : history)
+        indexHistoryEntry(cmd);
+}
+
+// case-insensitive substring test; `needle` is already folded
+static bool containsFolded(string_view hay, const string &needle)
+{
+    if (needle.size() > hay.size())
+        return false;
+    for (size_t i = 0; i + needle.size() <= hay.size(); ++i)
     {
-        istringstream iss(line);
-        int num;
-        if (iss >> num) lastNum = max(lastNum, num);
+        size_t k = 0;
+        while (k < needle.size() && foldChar(hay[i + k]) == (unsigned char)needle[k])
+            ++k;
+        if (k == needle.size())
+            return true;
     }
-    in.close();
-    return lastNum;
+    return false;
 }
-string searchHistory(const string &input, const string &filename = FILENAME)
-{
-    ifstream in(filename);
-    if (!in)
-        return "No match for search term in history";
 
-    vector<string> history;
-    string line;
+// length of the shortest window of `hay` holding `needle` as a subsequence
+// (case-insensitive), or -1
+static int subsequenceSpan(string_view hay, const string &needle)
+{
+    int best = -1;
+    for (size_t start = 0; start < hay.size(); ++start)
+    {
+        if (foldChar(hay[start]) != (unsigned char)needle[0])
+            continue;
+        size_t k = 0, i = start;
+        for (; i < hay.size() && k < needle.size(); ++i)
+            if (foldChar(hay[i]) == (unsigned char)needle[k])
+                ++k;
+        if (k < needle.size())
+            break; // no later start can match either
+        int span = (int)(i - start);
+        if (best < 0 || span < best)
+            best = span;
+    }
+    return best;
+}
 
-    while (getline(in, line))
+// Call fn(id) for entries whose mask covers `qmask`, newest first, until it
+// returns false.
+template <class Fn>
+static void scanHistoryMasks(uint64_t qmask, Fn fn)
+{
+    for (int b = (int)histIndex.blockMasks.size() - 1; b >= 0; --b)
     {
-        size_t pos = line.find_first_not_of(" 0123456789");
-        if (pos != string::npos) history.push_back(line.substr(pos));
-        else history.push_back("");
+        if ((histIndex.blockMasks[b] & qmask) != qmask)
+            continue;
+        int lo = b * HISTORY_BLOCK;
+        int hi = min((int)histIndex.masks.size(), lo + HISTORY_BLOCK);
+        for (int id = hi - 1; id >= lo; --id)
+            if ((histIndex.masks[id] & qmask) == qmask && !fn(id))
+                return;
     }
-    in.close();
+}
+
+struct HistoryHit
+{
+    int id = -1;
+    bool fuzzy = false;
+};
 
-    string exactMatch = "";
-    vector<string> candidates;
-    int maxPrefixLen = 0;
+// Newest entry containing `query`; failing that, the entry holding it as
+// the tightest subsequence (newest wins ties) among the most recent
+// candidates.
+HistoryHit findInHistory(const string &query, const vector<string_view> &history)
+{
+    HistoryHit hit;
+    if (query.empty() || history.size() != histIndex.masks.size())
+        return hit;
+    string q;
+    for (unsigned char c : query)
+        q += (char)foldChar(c);
+    uint64_t qmask = charMask(q);
 
-    for (auto it = history.rbegin(); it != history.rend(); ++it)
+    if (q.size() >= 3)
+    {
+        vector<const vector<uint32_t> *> lists;
+        for (size_t i = 0; i + 3 <= q.size(); ++i)
+        {
+            uint32_t g = (uint32_t)(unsigned char)q[i] << 16 | (uint32_t)(unsigned char)q[i + 1] << 8 | (unsigned char)q[i + 2];
+            auto it = histIndex.postings.find(g);
+            if (it == histIndex.postings.end())
+            {
+                lists.clear();
+                break;
+            }
+            lists.push_back(&it->second);
+        }
+        if (!lists.empty())
+        {
+            sort(lists.begin(), lists.end());
+            lists.erase(unique(lists.begin(), lists.end()), lists.end());
+            sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+            const vector<uint32_t> &rarest = *lists[0];
+            for (auto it = rarest.rbegin(); it != rarest.rend(); ++it)
+            {
+                bool inAll = true;
+                for (size_t l = 1; l < lists.size() && inAll; ++l)
+                    inAll = binary_search(lists[l]->begin(), lists[l]->end(), *it);
+                if (inAll && containsFolded(history[*it], q))
+                {
+                    hit.id = (int)*it;
+                    return hit;
+                }
+            }
+        }
+    }
+    else
     {
-        string cmd = *it;
+        scanHistoryMasks(qmask, [&](int id)
+                         {
+            if (!containsFolded(history[id], q))
+                return true;
+            hit.id = id;
+            return false; });
+        if (hit.id >= 0)
+            return hit;
+    }
 
-        if (cmd == input)
+    // fuzzy fallback
+    const int FUZZY_CANDIDATES = 2000;
+    int bestSpan = -1, seen = 0;
+    scanHistoryMasks(qmask, [&](int id)
+                     {
+        int span = subsequenceSpan(history[id], q);
+        if (span >= 0 && (bestSpan < 0 || span < bestSpan))
         {
-            exactMatch = cmd;
-            break;
+            bestSpan = span;
+            hit.id = id;
+            hit.fuzzy = true;
         }
-        int prefixLen = commonPrefixLength(cmd, input);
-        if (prefixLen > maxPrefixLen)
+        return ++seen < FUZZY_CANDIDATES; });
+    return hit;
+}
+
+string searchHistory(const string &input, const vector<string_view> &history)
+{
+    HistoryHit hit = findInHistory(input, history);
+    if (hit.id >= 0)
+        return string(history[hit.id]);
+    return "No match for search term in history";
+}
+
+
+// history.bin: a HistoryHeader, then one record per entry, oldest first
+// (uint32 length + bytes). A rewrite (the first import, compaction) ends
+// the file with the offsets of all records as a uint64 array and points
+// the header at it; records appended after that are found by scanning from
+// the end of that index. At startup the file is mmap'd and the entries are
+// string_views into the mapping; entries added later live in
+// HistoryStore::owned. Once the file holds HISTORY_SLACK entries past
+// HISTORY_MAX it is rewritten with the newest HISTORY_MAX entries.
+//
+// Several myterm processes share the file. Appends and rewrites happen
+// under an exclusive flock(), reads under a shared one. Each process
+// remembers how far it has read (readOffset); before appending, its writer
+// first reads what the others appended, so its own records land exactly at
+// readOffset and are never read back as someone else's. Those other
+// entries are passed to the UI through `incoming` (pullHistory), together
+// with markers for where our own records landed between them, so the UI
+// can keep `inputs` in file order and history numbers agree between
+// processes and with a fresh load. When
+// another process compacts, the path names a new inode: the writer reopens
+// it and resumes after the last entry number it knew, found through the
+// new file's index.
+//
+// The UI thread never touches the file after startup: storeInput queues
+// the record and a writer thread appends everything queued in one write
+// (group commit), at most MYTERM_HISTORY_FLUSH_MS after the first record
+// arrived. MYTERM_HISTORY_FSYNC picks when the data is fsync'd: "never"
+// (default), "batch" (after every write) or "exit". An idle writer checks
+// every HISTORY_POLL_MS for entries from other processes.
+const size_t HISTORY_MAX = 10000;
+const size_t HISTORY_SLACK = 1000;
+const int HISTORY_FLUSH_MS = 1000;
+const int HISTORY_POLL_MS = 1000;
+const size_t HISTORY_BATCH_BYTES = 64 * 1024; // write early once this much is queued
+
+struct HistoryHeader
+{
+    char magic[8];
+    uint64_t indexOffset; // 0 = no index
+    uint64_t indexCount;
+    uint64_t firstNum;    // history number of the first record
+};
+static const char HISTORY_MAGIC[8] = {'M', 'Y', 'T', 'H', 'I', 'S', 'T', '1'};
+
+enum HistoryFsync
+{
+    FSYNC_NEVER,
+    FSYNC_BATCH,
+    FSYNC_EXIT
+};
+
+struct HistoryStore
+{
+    // UI thread
+    const char *map = nullptr; // startup mapping, backs the loaded views
+    size_t mapLen = 0;
+    deque<string> owned;       // entries stored or merged since startup
+    long long baseNum = 1;     // history number of inputs[0]
+    size_t unwritten = 0;      // own entries at the end of inputs not yet known to be in the file
+
+    // writer thread (the UI thread only before it starts)
+    thread writer;
+    int fd = -1;               // O_RDWR | O_APPEND
+    ino_t ino = 0;
+    uint64_t readOffset = 0;   // everything before this has been read
+    long long firstNum = 1;    // number of the file's first record
+    size_t fileRecords = 0;
+    int flushMs = HISTORY_FLUSH_MS;
+    HistoryFsync fsyncPolicy = FSYNC_NEVER;
+
+    // shared
+    mutex mtx;
+    condition_variable cv;
+    string queued;             // encoded records for the writer; guarded by mtx
+    size_t queuedCount = 0;    // guarded by mtx
+    vector<pair<string, bool>> incoming; // file order: other processes' entries, and
+                                         // (own = true) where our next queued one went; guarded by mtx
+    bool stopping = false;     // guarded by mtx
+};
+static HistoryStore hist;
+
+static bool writeAll(int fd, const char *p, size_t left)
+{
+    while (left > 0)
+    {
+        ssize_t w = write(fd, p, left);
+        if (w < 0)
         {
-            maxPrefixLen = prefixLen;
-            candidates.clear();
-            candidates.push_back(cmd);
+            if (errno == EINTR)
+                continue;
+            return false;
         }
-        else if (prefixLen == maxPrefixLen)
+        p += w;
+        left -= w;
+    }
+    return true;
+}
+
+static bool readAt(int fd, void *buf, size_t len, uint64_t off)
+{
+    char *p = (char *)buf;
+    while (len > 0)
+    {
+        ssize_t r = pread(fd, p, len, (off_t)off);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        len -= r;
+        off += r;
+    }
+    return true;
+}
+
+static void appendRecord(string &buf, string_view cmd)
+{
+    uint32_t len = (uint32_t)cmd.size();
+    buf.append((const char *)&len, sizeof(len));
+    buf.append(cmd.data(), cmd.size());
+}
+
+// A complete, indexed history file.
+static string encodeHistoryFile(long long firstNum, const vector<string_view> &entries)
+{
+    string buf(sizeof(HistoryHeader), '\0');
+    vector<uint64_t> offs;
+    offs.reserve(entries.size());
+    for (auto e : entries)
+    {
+        offs.push_back(buf.size());
+        appendRecord(buf, e);
+    }
+    HistoryHeader h{};
+    memcpy(h.magic, HISTORY_MAGIC, sizeof(h.magic));
+    h.indexOffset = buf.size();
+    h.indexCount = offs.size();
+    h.firstNum = (uint64_t)firstNum;
+    memcpy(&buf[0], &h, sizeof(h));
+    buf.append((const char *)offs.data(), offs.size() * sizeof(uint64_t));
+    return buf;
+}
+
+static bool writeHistoryFile(const string &path, long long firstNum, const vector<string_view> &entries)
+{
+    string buf = encodeHistoryFile(firstNum, entries);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = writeAll(fd, buf.data(), buf.size());
+    close(fd);
+    return ok;
+}
+
+// Find the records of a history file image. Returns the offset just past
+// the last complete record (or index), or 0 if this is not a history file.
+static uint64_t parseHistoryFile(const char *data, size_t len, HistoryHeader &h, vector<uint64_t> &offsets)
+{
+    offsets.clear();
+    if (len < sizeof(HistoryHeader))
+        return 0;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, HISTORY_MAGIC, sizeof(h.magic)) != 0)
+        return 0;
+    uint64_t pos = sizeof(HistoryHeader);
+    if (h.indexOffset && h.indexOffset + h.indexCount * sizeof(uint64_t) <= len)
+    {
+        const char *idx = data + h.indexOffset;
+        for (uint64_t i = 0; i < h.indexCount; ++i)
         {
-            candidates.push_back(cmd);
+            uint64_t off;
+            uint32_t rlen = 0;
+            memcpy(&off, idx + i * sizeof(off), sizeof(off));
+            if (off + sizeof(rlen) <= len)
+                memcpy(&rlen, data + off, sizeof(rlen));
+            if (off + sizeof(rlen) + rlen > len)
+                break; // corrupt index: keep what precedes it
+            offsets.push_back(off);
         }
+        pos = h.indexOffset + h.indexCount * sizeof(uint64_t);
+    }
+    // records after the index
+    while (pos + sizeof(uint32_t) <= len)
+    {
+        uint32_t rlen;
+        memcpy(&rlen, data + pos, sizeof(rlen));
+        if (pos + sizeof(rlen) + rlen > len)
+            break;
+        offsets.push_back(pos);
+        pos += sizeof(rlen) + rlen;
     }
+    return pos;
+}
 
-    if (!exactMatch.empty())
-        return exactMatch;
+// writer: read the complete records in [from, to) and hand them to the UI;
+// returns the offset after the last one
+static uint64_t readRecords(uint64_t from, uint64_t to)
+{
+    if (to <= from)
+        return from;
+    string buf(to - from, '\0');
+    if (!readAt(hist.fd, &buf[0], buf.size(), from))
+        return from;
+    vector<string> got;
+    size_t p = 0;
+    while (p + sizeof(uint32_t) <= buf.size())
+    {
+        uint32_t len;
+        memcpy(&len, buf.data() + p, sizeof(len));
+        if (p + sizeof(len) + len > buf.size())
+            break;
+        got.emplace_back(buf, p + sizeof(len), len);
+        p += sizeof(len) + len;
+    }
+    hist.fileRecords += got.size();
+    if (!got.empty())
+    {
+        lock_guard<mutex> lk(hist.mtx);
+        for (auto &g : got)
+            hist.incoming.emplace_back(std::move(g), false);
+    }
+    return from + p;
+}
 
-    if (maxPrefixLen >= 2)
-        return candidates[0];
+// writer: read what other processes appended past readOffset
+static void readNewHistory()
+{
+    struct stat st{};
+    if (fstat(hist.fd, &st) == 0)
+        hist.readOffset = readRecords(hist.readOffset, st.st_size);
+}
 
-    return "No match for search term in history";
+// writer: the path was replaced by a compaction elsewhere; switch to the
+// new file and continue after the last entry we already know
+static bool reopenHistory()
+{
+    int fd = open(HISTORY_BIN.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    struct stat st{};
+    HistoryHeader h{};
+    if (fd < 0 || fstat(fd, &st) != 0 || !readAt(fd, &h, sizeof(h), 0) ||
+        memcmp(h.magic, HISTORY_MAGIC, sizeof(h.magic)) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    long long known = hist.firstNum + (long long)hist.fileRecords; // next number we have not seen
+    uint64_t skip = known > (long long)h.firstNum ? (uint64_t)(known - (long long)h.firstNum) : 0;
+    uint64_t indexed = h.indexOffset ? h.indexCount : 0;
+    uint64_t tail = h.indexOffset ? h.indexOffset + h.indexCount * sizeof(uint64_t) : sizeof(HistoryHeader);
+    uint64_t from = 0, seen = skip;
+    if (skip < indexed)
+        readAt(fd, &from, sizeof(from), h.indexOffset + skip * sizeof(uint64_t));
+    else
+    {
+        // skip records of the unindexed tail one length at a time
+        from = tail;
+        for (seen = indexed; seen < skip && from + sizeof(uint32_t) <= (uint64_t)st.st_size; ++seen)
+        {
+            uint32_t len;
+            if (!readAt(fd, &len, sizeof(len), from))
+                break;
+            from += sizeof(len) + len;
+        }
+    }
+    flock(hist.fd, LOCK_UN);
+    close(hist.fd);
+    hist.fd = fd;
+    hist.ino = st.st_ino;
+    hist.firstNum = (long long)h.firstNum;
+    hist.fileRecords = seen;
+    hist.readOffset = from;
+    if (skip < indexed)
+    {
+        // the rest of the indexed records, then continue after the index
+        readRecords(from, h.indexOffset);
+        hist.readOffset = tail;
+    }
+    return true;
+}
+
+// writer: flock the file that the path currently names
+static void lockHistory(int op)
+{
+    while (hist.fd >= 0)
+    {
+        if (flock(hist.fd, op) != 0 && errno != EINTR)
+            return;
+        struct stat st{};
+        if (stat(HISTORY_BIN.c_str(), &st) != 0 || st.st_ino == hist.ino)
+            return;
+        if (!reopenHistory()) // drops the lock on the old file
+            return;
+    }
+}
+
+// writer, holding LOCK_EX with everything read: keep the newest
+// HISTORY_MAX entries. The new file is locked before the rename so nobody
+// can append to it before we know its size.
+static void compactHistoryLocked()
+{
+    struct stat st{};
+    if (fstat(hist.fd, &st) != 0)
+        return;
+    string buf(st.st_size, '\0');
+    HistoryHeader h{};
+    vector<uint64_t> offs;
+    if (!readAt(hist.fd, &buf[0], buf.size(), 0) || !parseHistoryFile(buf.data(), buf.size(), h, offs))
+        return;
+    size_t drop = offs.size() > HISTORY_MAX ? offs.size() - HISTORY_MAX : 0;
+    vector<string_view> keep;
+    for (size_t i = drop; i < offs.size(); ++i)
+    {
+        uint32_t len;
+        memcpy(&len, buf.data() + offs[i], sizeof(len));
+        keep.emplace_back(buf.data() + offs[i] + sizeof(len), len);
+    }
+    long long firstNum = (long long)h.firstNum + (long long)drop;
+    string out = encodeHistoryFile(firstNum, keep);
+
+    string tmp = HISTORY_BIN + ".tmp";
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+    flock(fd, LOCK_EX);
+    if (!writeAll(fd, out.data(), out.size()) || fstat(fd, &st) != 0 || rename(tmp.c_str(), HISTORY_BIN.c_str()) != 0)
+    {
+        close(fd);
+        unlink(tmp.c_str());
+        cerr << "Error compacting history\n";
+        return;
+    }
+    flock(hist.fd, LOCK_UN);
+    close(hist.fd);
+    hist.fd = fd;
+    hist.ino = st.st_ino;
+    hist.firstNum = firstNum;
+    hist.fileRecords = keep.size();
+    hist.readOffset = out.size();
+}
+
+static void historyWriterLoop()
+{
+    unique_lock<mutex> lk(hist.mtx);
+    while (true)
+    {
+        if (hist.queued.empty() && !hist.stopping)
+            hist.cv.wait_for(lk, chrono::milliseconds(HISTORY_POLL_MS), []
+                             { return hist.stopping || !hist.queued.empty(); });
+        // group commit: give more records a chance to join this write
+        if (!hist.queued.empty() && !hist.stopping && hist.flushMs > 0)
+            hist.cv.wait_for(lk, chrono::milliseconds(hist.flushMs), []
+                             { return hist.stopping || hist.queued.size() >= HISTORY_BATCH_BYTES; });
+        string batch;
+        batch.swap(hist.queued);
+        size_t count = hist.queuedCount;
+        hist.queuedCount = 0;
+        bool stop = hist.stopping;
+        lk.unlock();
+
+        if (hist.fd >= 0 && !batch.empty())
+        {
+            lockHistory(LOCK_EX);
+            readNewHistory(); // others' entries first, so ours start at readOffset
+            if (writeAll(hist.fd, batch.data(), batch.size()))
+            {
+                hist.readOffset += batch.size();
+                hist.fileRecords += count;
+                lock_guard<mutex> ilk(hist.mtx);
+                for (size_t i = 0; i < count; ++i)
+                    hist.incoming.emplace_back(string(), true);
+                if (hist.fsyncPolicy == FSYNC_BATCH)
+                    fdatasync(hist.fd);
+            }
+            else
+                cerr << "Error writing history: " << strerror(errno) << "\n";
+            if (hist.fileRecords > HISTORY_MAX + HISTORY_SLACK)
+                compactHistoryLocked();
+            flock(hist.fd, LOCK_UN);
+        }
+        else if (hist.fd >= 0 && !stop)
+        {
+            // idle: pick up what other processes appended
+            struct stat st{};
+            if (stat(HISTORY_BIN.c_str(), &st) == 0 && (st.st_ino != hist.ino || (uint64_t)st.st_size > hist.readOffset))
+            {
+                lockHistory(LOCK_SH);
+                readNewHistory();
+                flock(hist.fd, LOCK_UN);
+            }
+        }
+
+        lk.lock();
+        if (stop && hist.queued.empty())
+            break;
+    }
+    lk.unlock();
+    if (hist.fd >= 0)
+    {
+        if (hist.fsyncPolicy == FSYNC_EXIT)
+            fdatasync(hist.fd);
+        close(hist.fd);
+        hist.fd = -1;
+    }
 }
 
+static void startHistoryWriter()
+{
+    if (const char *ms = getenv("MYTERM_HISTORY_FLUSH_MS"))
+        hist.flushMs = max(0, atoi(ms));
+    if (const char *fs = getenv("MYTERM_HISTORY_FSYNC"))
+    {
+        string v = fs;
+        hist.fsyncPolicy = v == "batch" ? FSYNC_BATCH : v == "exit" ? FSYNC_EXIT : FSYNC_NEVER;
+    }
+    hist.writer = thread(historyWriterLoop);
+}
 
-vector<string> loadInputs()
+// Write everything still queued and stop the writer.
+void closeHistory()
 {
-    ifstream in(FILENAME);
-    vector<string> inputs;
-    if (!in) {
-        return inputs;
+    if (!hist.writer.joinable())
+        return;
+    {
+        lock_guard<mutex> lk(hist.mtx);
+        hist.stopping = true;
     }
+    hist.cv.notify_one();
+    hist.writer.join();
+}
 
+// Parse a history.txt ("  N  command" lines) for import.
+static bool readTextHistory(const string &path, vector<string> &cmds, long long &lastNum)
+{
+    ifstream in(path);
+    if (!in)
+        return false;
     string line;
+    lastNum = 0;
     while (getline(in, line))
     {
         size_t pos = line.find_first_not_of(" 0123456789");
-        if (pos != string::npos)
-            inputs.push_back(line.substr(pos));
-        else
-            inputs.push_back("");
+        cmds.push_back(pos != string::npos ? line.substr(pos) : "");
+        lastNum = max(lastNum, atoll(line.c_str()));
     }
+    return true;
+}
 
-    in.close();
-    return inputs;
+// Number of the entry inputs[i].
+long long historyNumber(size_t i)
+{
+    return hist.baseNum + (long long)i;
 }
-void storeInput(const string &input)
+
+// `history -w`: write the history as text, in the old history.txt format.
+bool exportHistoryText(const string &path, const vector<string_view> &inputs)
 {
-    int histNum = getLastHistoryNumber() + 1;
-    ofstream out(FILENAME, ios::app);
+    ofstream out(path, ios::trunc);
     if (!out)
+        return false;
+    for (size_t i = 0; i < inputs.size(); ++i)
+        out << "  " << historyNumber(i) << "  " << inputs[i] << '\n';
+    return (bool)out;
+}
+
+// Map history.bin (importing history.txt the first time) and return views
+// of its newest HISTORY_MAX entries; also primes the store, the search
+// index and the writer.
+vector<string_view> loadInputs()
+{
+    struct stat st{};
+    if (stat(HISTORY_BIN.c_str(), &st) != 0)
     {
-        cerr << "Error opening file for writing.\n";
-        return;
+        vector<string> cmds;
+        long long lastNum = 0;
+        bool imported = readTextHistory(FILENAME, cmds, lastNum);
+        vector<string_view> v(cmds.begin(), cmds.end());
+        long long firstNum = imported ? lastNum - (long long)cmds.size() + 1 : 1;
+        // another instance may be doing the same; the rename keeps it whole
+        string tmp = HISTORY_BIN + ".new." + to_string(getpid());
+        if (!writeHistoryFile(tmp, max(1LL, firstNum), v) || link(tmp.c_str(), HISTORY_BIN.c_str()) != 0)
+            if (errno != EEXIST)
+                cerr << "Error creating " << HISTORY_BIN << "\n";
+        unlink(tmp.c_str());
+    }
+
+    // lock the file the path names (it may be replaced while we wait)
+    int fd = -1;
+    while (true)
+    {
+        fd = open(HISTORY_BIN.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+        if (fd < 0)
+            break;
+        flock(fd, LOCK_EX);
+        struct stat pst{};
+        if (fstat(fd, &st) == 0 && stat(HISTORY_BIN.c_str(), &pst) == 0 && pst.st_ino == st.st_ino)
+            break;
+        close(fd);
+    }
+
+    vector<string_view> inputs;
+    if (fd >= 0 && (size_t)st.st_size >= sizeof(HistoryHeader))
+    {
+        // map through a descriptor of its own: a mapping keeps its open
+        // file alive, and with it any flock taken through that file
+        int mfd = open(HISTORY_BIN.c_str(), O_RDONLY | O_CLOEXEC);
+        hist.mapLen = st.st_size;
+        void *m = mfd < 0 ? MAP_FAILED : mmap(nullptr, hist.mapLen, PROT_READ, MAP_SHARED, mfd, 0);
+        hist.map = m == MAP_FAILED ? nullptr : (const char *)m;
+        if (mfd >= 0)
+            close(mfd);
+    }
+    HistoryHeader h{};
+    vector<uint64_t> offs;
+    uint64_t end = hist.map ? parseHistoryFile(hist.map, hist.mapLen, h, offs) : 0;
+    if (end)
+    {
+        for (uint64_t off : offs)
+        {
+            uint32_t len;
+            memcpy(&len, hist.map + off, sizeof(len));
+            inputs.emplace_back(hist.map + off + sizeof(len), len);
+        }
+        // drop a record cut short by a crash so later appends stay aligned
+        if (end < hist.mapLen && ftruncate(fd, end) == 0)
+            hist.mapLen = end;
+        hist.firstNum = (long long)h.firstNum;
     }
-    out << "  " << histNum << "  " << input << endl;
-    out.close();
+    else if (fd >= 0)
+    {
+        cerr << "Unreadable " << HISTORY_BIN << ", starting a new history\n";
+        if (hist.map)
+            munmap((void *)hist.map, hist.mapLen);
+        hist.map = nullptr;
+        rename(HISTORY_BIN.c_str(), (HISTORY_BIN + ".bad").c_str());
+        close(fd);
+        writeHistoryFile(HISTORY_BIN, 1, {});
+        fd = open(HISTORY_BIN.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+        if (fd >= 0)
+            flock(fd, LOCK_EX);
+        end = sizeof(HistoryHeader);
+        hist.firstNum = 1;
+    }
+    if (fd >= 0)
+    {
+        fstat(fd, &st);
+        hist.fd = fd;
+        hist.ino = st.st_ino;
+        hist.readOffset = end;
+        hist.fileRecords = inputs.size();
+        flock(fd, LOCK_UN);
+    }
+
+    hist.baseNum = hist.firstNum;
+    if (inputs.size() > HISTORY_MAX)
+    {
+        hist.baseNum += (long long)(inputs.size() - HISTORY_MAX);
+        inputs.erase(inputs.begin(), inputs.end() - HISTORY_MAX);
+    }
+    buildHistoryIndex(inputs);
+
+    if (!hist.writer.joinable())
+    {
+        startHistoryWriter();
+        atexit(closeHistory);
+    }
+    return inputs;
 }
 
+// Record `input`; returns a view of the stored copy for `inputs`. Until
+// the writer has appended it, it stays at the end of `inputs` and its
+// number is provisional: entries other processes wrote first go before it.
+string_view storeInput(const string &input)
+{
+    hist.unwritten++;
+    hist.owned.push_back(input);
+    string_view v = hist.owned.back();
+    indexHistoryEntry(v);
+    {
+        lock_guard<mutex> lk(hist.mtx);
+        appendRecord(hist.queued, v);
+        hist.queuedCount++;
+    }
+    hist.cv.notify_one();
+    return v;
+}
 
+// Add the entries other myterm processes recorded since the last call, in
+// the order they are in the file: before our own entries that were written
+// after them. Returns how many were added.
+size_t pullHistory(vector<string_view> &inputs)
+{
+    vector<pair<string, bool>> got;
+    {
+        lock_guard<mutex> lk(hist.mtx);
+        got.swap(hist.incoming);
+    }
+    size_t added = 0;
+    bool reordered = false;
+    for (auto &[entry, own] : got)
+    {
+        if (own)
+        {
+            // our oldest unwritten entry is in the file from here on
+            if (hist.unwritten > 0)
+                hist.unwritten--;
+            continue;
+        }
+        hist.owned.push_back(std::move(entry));
+        string_view v = hist.owned.back();
+        inputs.insert(inputs.end() - min(hist.unwritten, inputs.size()), v);
+        if (hist.unwritten > 0)
+            reordered = true;
+        else
+            indexHistoryEntry(v);
+        ++added;
+    }
+    // search ids are positions in inputs
+    if (reordered)
+        buildHistoryIndex(inputs);
+    return added;
+}
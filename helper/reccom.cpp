@@ -21,15 +21,25 @@
 #include <regex>
 #include <sys/stat.h>
 #include <limits.h>
+#include <dirent.h>
 using namespace std;
 
-vector<string> getRecomm(string query, vector<string> list)
+// Candidates starting with `query`. `list` must be sorted, so the matches
+// are one contiguous run: found with two binary searches, and only that
+// run is copied.
+vector<string> getRecomm(const string &query, const vector<string> &list)
 {
-    vector<string> recs;
-    for (auto &ele : list)
-        if (ele.rfind(query, 0) == 0)
-            recs.push_back(ele);
-    return recs;
+    auto lo = lower_bound(list.begin(), list.end(), query);
+    auto hi = partition_point(lo, list.end(), [&](const string &s)
+                              { return s.compare(0, query.size(), query) == 0; });
+    return vector<string>(lo, hi);
+}
+
+// Longest prefix shared by every entry of a sorted, non-empty run: the one
+// shared by its first and last entries.
+string commonPrefix(const vector<string> &sorted)
+{
+    return sorted.front().substr(0, commonPrefixLength(sorted.front(), sorted.back()));
 }
 int getRecIdx(string inp)
 {
@@ -48,3 +58,536 @@ string getQuery(string input)
     }
     return query;
 }
+
+// Directory listings for Tab completion, read with readdir (getdents64)
+// and cached per directory until its mtime changes. Like `ls`, names
+// starting with '.' are hidden and the rest are sorted. The cache is only
+// touched by the UI thread; workers hand listings over through
+// prefetchState.
+struct DirListing
+{
+    dev_t dev = 0;
+    ino_t ino = 0;
+    struct timespec mtime{};
+    bool racy = false; // listed within the mtime's granularity; reread next time
+    vector<string> names;
+};
+
+// least recently used listings are dropped once either bound is passed
+struct CachedDir
+{
+    DirListing listing;
+    list<string>::iterator lru;
+};
+static unordered_map<string, CachedDir> dirCache;
+static list<string> dirLru; // most recently used first
+static size_t dirCacheNames = 0;
+static const size_t DIR_CACHE_MAX = 256;
+static const size_t DIR_CACHE_NAMES_MAX = 1 << 20;
+static const vector<string> noListing;
+
+// the cd prefetcher's one worker: the latest request waiting for it, and
+// the listings it read, waiting for the UI thread to adopt
+struct PrefetchState
+{
+    mutex mtx;
+    condition_variable wanted;              // worker: pending was set
+    string pending;                         // guarded by mtx: only the latest cd
+    bool hasPending = false;                // guarded by mtx
+    vector<pair<string, DirListing>> ready; // guarded by mtx
+    atomic<unsigned> generation{0};          // bumped by each cd; older runs stop
+};
+// never freed: the worker lives as long as the process
+static PrefetchState &prefetchState = *new PrefetchState;
+
+static bool listingCurrent(const DirListing &L, const struct stat &st)
+{
+    return !L.racy && L.dev == st.st_dev && L.ino == st.st_ino && L.mtime.tv_sec == st.st_mtim.tv_sec &&
+           L.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+// A change landing in the same timestamp tick as our read would not move
+// the mtime, so what was read from a directory modified that recently is
+// not trusted to be current next time.
+static bool mtimeRacy(const struct stat &st)
+{
+    struct timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec - st.st_mtim.tv_sec < 2;
+}
+
+// record which version of the directory `L` was read from; `st` must be
+// taken before reading
+static void stampListing(DirListing &L, const struct stat &st)
+{
+    L.dev = st.st_dev;
+    L.ino = st.st_ino;
+    L.mtime = st.st_mtim;
+    L.racy = mtimeRacy(st);
+}
+
+// read the visible names of an open directory, sorted; false if it has more
+// than `limit` or `stop` turns true first
+static bool readListing(DIR *d, DirListing &L, size_t limit, const function<bool()> &stop)
+{
+    while (struct dirent *e = readdir(d))
+    {
+        if (e->d_name[0] == '.')
+            continue;
+        if (L.names.size() >= limit || stop())
+            return false;
+        L.names.push_back(e->d_name);
+    }
+    sort(L.names.begin(), L.names.end());
+    return true;
+}
+
+static const vector<string> &storeListing(const string &dir, DirListing &&L)
+{
+    auto it = dirCache.find(dir);
+    if (it == dirCache.end())
+    {
+        dirLru.push_front(dir);
+        it = dirCache.emplace(dir, CachedDir()).first;
+        it->second.lru = dirLru.begin();
+    }
+    else
+    {
+        dirLru.splice(dirLru.begin(), dirLru, it->second.lru);
+        dirCacheNames -= it->second.listing.names.size();
+    }
+    it->second.listing = move(L);
+    dirCacheNames += it->second.listing.names.size();
+    while (dirCache.size() > 1 && (dirCache.size() > DIR_CACHE_MAX || dirCacheNames > DIR_CACHE_NAMES_MAX))
+    {
+        auto old = dirCache.find(dirLru.back());
+        dirCacheNames -= old->second.listing.names.size();
+        dirCache.erase(old);
+        dirLru.pop_back();
+    }
+    return it->second.listing.names;
+}
+
+static void adoptPrefetched()
+{
+    vector<pair<string, DirListing>> ready;
+    {
+        lock_guard<mutex> lk(prefetchState.mtx);
+        ready.swap(prefetchState.ready);
+    }
+    for (auto &[dir, L] : ready)
+        storeListing(dir, move(L));
+}
+
+// cached listing of `dir` if it is still current; marks it recently used
+static const vector<string> *findListing(const string &dir, const struct stat &st)
+{
+    adoptPrefetched();
+    auto it = dirCache.find(dir);
+    if (it == dirCache.end() || !listingCurrent(it->second.listing, st))
+        return nullptr;
+    dirLru.splice(dirLru.begin(), dirLru, it->second.lru);
+    return &it->second.listing.names;
+}
+
+// Listing of `dir` if the cache has it current (an empty one if `dir` is
+// not a directory), nullptr if it would have to be read.
+const vector<string> *cachedDirectory(const string &dir)
+{
+    struct stat st{};
+    if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return &noListing;
+    return findListing(dir, st);
+}
+
+const vector<string> &listDirectory(const string &dir)
+{
+    struct stat st{};
+    if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return noListing;
+    if (const vector<string> *cached = findListing(dir, st))
+        return *cached;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return noListing;
+    DirListing L;
+    readListing(d, L, SIZE_MAX, []
+                { return false; });
+    closedir(d);
+    stampListing(L, st);
+    return storeListing(dir, move(L));
+}
+
+// After a cd: read `dir` and its immediate subdirectories in the background
+// so completing in them (`sub/x<Tab>`) finds the listing cached. Stops when
+// a newer cd asks for another run; directories too big to be worth holding
+// are skipped and left to the on-demand scan.
+static const size_t PREFETCH_DIRS_MAX = 128;
+static const size_t PREFETCH_NAMES_MAX = 20000;
+
+static void prefetchRun(const string &dir, unsigned generation)
+{
+    auto stale = [generation]
+    { return prefetchState.generation != generation; };
+    auto readOne = [&](int parent, const string &path, const char *name, vector<string> *subdirs)
+    {
+        int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        struct stat st{};
+        if (fd < 0 || fstat(fd, &st) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        DIR *d = fdopendir(fd);
+        if (!d)
+        {
+            close(fd);
+            return -1;
+        }
+        DirListing L;
+        bool whole = readListing(d, L, PREFETCH_NAMES_MAX, stale);
+        if (subdirs)
+        {
+            // d_type is DT_UNKNOWN on some filesystems: then ask stat
+            rewinddir(d);
+            while (struct dirent *e = readdir(d))
+            {
+                struct stat sst{};
+                if (e->d_name[0] != '.' && subdirs->size() < PREFETCH_DIRS_MAX &&
+                    (e->d_type == DT_DIR ||
+                     (e->d_type == DT_UNKNOWN && fstatat(fd, e->d_name, &sst, 0) == 0 && S_ISDIR(sst.st_mode))))
+                    subdirs->push_back(e->d_name);
+            }
+        }
+        int keep = subdirs ? dup(fd) : -1;
+        closedir(d);
+        if (whole && !stale())
+        {
+            stampListing(L, st);
+            lock_guard<mutex> lk(prefetchState.mtx);
+            prefetchState.ready.emplace_back(path, move(L));
+        }
+        return keep;
+    };
+
+    vector<string> subdirs;
+    int fd = readOne(AT_FDCWD, dir, dir.c_str(), &subdirs);
+    if (fd < 0)
+        return;
+    for (auto &name : subdirs)
+    {
+        if (stale())
+            break;
+        readOne(fd, dir == "/" ? "/" + name : dir + "/" + name, name.c_str(), nullptr);
+    }
+    close(fd);
+}
+
+// one persistent thread; cds made while it is busy collapse into the
+// latest one
+static void prefetchWorker()
+{
+    unique_lock<mutex> lk(prefetchState.mtx);
+    for (;;)
+    {
+        prefetchState.wanted.wait(lk, []
+                                  { return prefetchState.hasPending; });
+        string dir = move(prefetchState.pending);
+        prefetchState.hasPending = false;
+        unsigned generation = prefetchState.generation;
+        lk.unlock();
+        prefetchRun(dir, generation);
+        lk.lock();
+    }
+}
+
+void prefetchDirectories(const string &dir)
+{
+    static once_flag started;
+    call_once(started, []
+              { thread(prefetchWorker).detach(); });
+    lock_guard<mutex> lk(prefetchState.mtx);
+    prefetchState.pending = dir;
+    prefetchState.hasPending = true;
+    ++prefetchState.generation; // stops the run in progress
+    prefetchState.wanted.notify_one();
+}
+
+// Split a completion token into the directory it names and the part of a
+// name to complete there: "src/ut" -> (cwd/src/, "ut"), "~/d" -> ($HOME/,
+// "d"), "../lib/fo" -> (cwd/../lib/, "fo"). A token without '/' completes
+// in cwd.
+void splitCompletionPath(const string &token, const string &cwd, string &dir, string &name)
+{
+    size_t slash = token.rfind('/');
+    if (slash == string::npos)
+    {
+        dir = cwd;
+        name = token;
+        return;
+    }
+    string part = token.substr(0, slash + 1);
+    name = token.substr(slash + 1);
+    if (part[0] == '/')
+        dir = part;
+    else if (part.rfind("~/", 0) == 0)
+    {
+        const char *home = getenv("HOME");
+        dir = string(home ? home : "") + part.substr(1);
+    }
+    else
+        dir = (cwd == "/" ? "" : cwd) + "/" + part;
+    // one spelling per directory, so the cache is not split by "a//b" or "x/../"
+    char resolved[PATH_MAX];
+    if (realpath(dir.c_str(), resolved))
+        dir = resolved;
+}
+
+// A completion whose directory is not cached, read on a worker thread so a
+// huge directory or a slow mount cannot stall the window. Matches are
+// published every SCAN_PUBLISH_MS while the scan runs; setting `cancelled`
+// stops it at the next entry.
+struct CompletionScan
+{
+    string dir;
+    string query;
+    atomic<bool> cancelled{false};
+    atomic<bool> updated{false}; // published since the UI last looked
+    mutex mtx;
+    condition_variable cv;    // signalled when done
+    vector<string> matches;   // guarded by mtx, sorted
+    bool done = false;        // guarded by mtx: the whole directory was read
+    DirListing listing;       // guarded by mtx: complete listing, once done
+};
+static const int SCAN_PUBLISH_MS = 50;
+
+static void publishMatches(CompletionScan &S, vector<string> &found, bool done, void (*notify)())
+{
+    sort(found.begin(), found.end());
+    {
+        lock_guard<mutex> lk(S.mtx);
+        size_t mid = S.matches.size();
+        S.matches.insert(S.matches.end(), make_move_iterator(found.begin()), make_move_iterator(found.end()));
+        inplace_merge(S.matches.begin(), S.matches.begin() + mid, S.matches.end());
+        S.done = done;
+    }
+    found.clear();
+    S.updated = true;
+    if (done)
+        S.cv.notify_all();
+    notify();
+}
+
+static void scanDirectory(shared_ptr<CompletionScan> S, void (*notify)())
+{
+    DirListing L;
+    struct stat st{};
+    DIR *d = opendir(S->dir.c_str());
+    if (d && fstat(dirfd(d), &st) != 0)
+    {
+        closedir(d);
+        d = nullptr;
+    }
+    vector<string> found; // matches not yet published
+    auto published = chrono::steady_clock::now();
+    while (d && !S->cancelled)
+    {
+        struct dirent *e = readdir(d);
+        if (!e)
+            break;
+        if (e->d_name[0] == '.')
+            continue;
+        L.names.push_back(e->d_name);
+        if (L.names.back().compare(0, S->query.size(), S->query) == 0)
+            found.push_back(L.names.back());
+        auto now = chrono::steady_clock::now();
+        if (!found.empty() && now - published >= chrono::milliseconds(SCAN_PUBLISH_MS))
+        {
+            publishMatches(*S, found, false, notify);
+            published = now;
+        }
+    }
+    if (d)
+        closedir(d);
+    if (S->cancelled)
+        return;
+    if (d)
+    {
+        sort(L.names.begin(), L.names.end());
+        stampListing(L, st);
+    }
+    {
+        lock_guard<mutex> lk(S->mtx);
+        S->listing = move(L);
+    }
+    publishMatches(*S, found, true, notify);
+}
+
+// Start reading `dir` for names beginning with `query`; `notify` is called
+// from the worker after each batch of matches.
+shared_ptr<CompletionScan> startScan(const string &dir, const string &query, void (*notify)())
+{
+    auto S = make_shared<CompletionScan>();
+    S->dir = dir;
+    S->query = query;
+    thread(scanDirectory, S, notify).detach();
+    return S;
+}
+
+// Wait up to `ms` for the scan to finish. When it has, its matches are
+// moved into `recs` and its listing into the cache.
+bool finishScan(CompletionScan &S, int ms, vector<string> &recs)
+{
+    unique_lock<mutex> lk(S.mtx);
+    if (!S.cv.wait_for(lk, chrono::milliseconds(ms), [&]
+                       { return S.done; }))
+        return false;
+    recs = move(S.matches);
+    if (S.listing.dev || S.listing.ino)
+        storeListing(S.dir, move(S.listing));
+    return true;
+}
+
+// Matches published so far, for a scan still running.
+vector<string> scanMatches(CompletionScan &S)
+{
+    lock_guard<mutex> lk(S.mtx);
+    return S.matches;
+}
+
+// Executables on $PATH, for completing the first word of a line. The
+// index is built on a background thread and swapped in whole, so lookups
+// only take a lock long enough to copy a shared_ptr. refreshPathIndex()
+// stats the PATH directories (cheap) and starts a rebuild when PATH or any
+// directory's mtime changed since the last build.
+struct PathIndex
+{
+    string path;                                 // $PATH it was built from
+    vector<pair<string, struct timespec>> stamps; // mtime of each directory
+    vector<string> missing;                      // entries that were not directories yet
+    vector<string> names;                        // sorted, unique
+};
+
+struct PathIndexState
+{
+    mutex mtx;
+    shared_ptr<const PathIndex> current; // guarded by mtx
+    bool building = false;               // guarded by mtx
+};
+// never freed: a build may still be running while the process exits
+static PathIndexState &pathIndexState = *new PathIndexState;
+
+static vector<string> pathDirs(const string &path)
+{
+    vector<string> dirs;
+    size_t from = 0;
+    while (from <= path.size())
+    {
+        size_t to = path.find(':', from);
+        if (to == string::npos)
+            to = path.size();
+        string dir = path.substr(from, to - from);
+        if (dir.empty())
+            dir = ".";
+        if (find(dirs.begin(), dirs.end(), dir) == dirs.end())
+            dirs.push_back(dir);
+        from = to + 1;
+    }
+    return dirs;
+}
+
+static bool sameTime(const struct timespec &a, const struct timespec &b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static void buildPathIndex(string path)
+{
+    auto idx = make_shared<PathIndex>();
+    idx->path = path;
+    for (auto &dir : pathDirs(path))
+    {
+        struct stat st{};
+        if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            // e.g. ~/.local/bin before anything is installed there
+            idx->missing.push_back(dir);
+            continue;
+        }
+        // a racy mtime is stamped as "unknown", so the next refresh rereads
+        idx->stamps.push_back({dir, mtimeRacy(st) ? timespec{} : st.st_mtim});
+
+        int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *d = dfd < 0 ? nullptr : fdopendir(dfd);
+        if (!d)
+        {
+            if (dfd >= 0)
+                close(dfd);
+            continue;
+        }
+        while (struct dirent *e = readdir(d))
+        {
+            if (e->d_name[0] == '.' || e->d_type == DT_DIR)
+                continue;
+            struct stat fst{};
+            if (fstatat(dfd, e->d_name, &fst, 0) == 0 && S_ISREG(fst.st_mode) &&
+                faccessat(dfd, e->d_name, X_OK, AT_EACCESS) == 0)
+                idx->names.push_back(e->d_name);
+        }
+        closedir(d);
+    }
+    sort(idx->names.begin(), idx->names.end());
+    idx->names.erase(unique(idx->names.begin(), idx->names.end()), idx->names.end());
+
+    lock_guard<mutex> lk(pathIndexState.mtx);
+    pathIndexState.current = idx;
+    pathIndexState.building = false;
+}
+
+// Start a background rebuild if PATH or one of its directories changed,
+// or a directory that was missing has appeared.
+void refreshPathIndex()
+{
+    const char *env = getenv("PATH");
+    string path = env ? env : "/usr/local/bin:/usr/bin:/bin";
+    shared_ptr<const PathIndex> cur;
+    {
+        lock_guard<mutex> lk(pathIndexState.mtx);
+        if (pathIndexState.building)
+            return;
+        cur = pathIndexState.current;
+    }
+    bool stale = !cur || cur->path != path;
+    for (size_t i = 0; cur && !stale && i < cur->stamps.size(); ++i)
+    {
+        struct stat st{};
+        stale = stat(cur->stamps[i].first.c_str(), &st) != 0 || !sameTime(st.st_mtim, cur->stamps[i].second);
+    }
+    for (size_t i = 0; cur && !stale && i < cur->missing.size(); ++i)
+    {
+        struct stat st{};
+        stale = stat(cur->missing[i].c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    if (!stale)
+        return;
+    {
+        lock_guard<mutex> lk(pathIndexState.mtx);
+        if (pathIndexState.building)
+            return;
+        pathIndexState.building = true;
+    }
+    thread(buildPathIndex, path).detach();
+}
+
+// Sorted executable names, empty until the first build finishes.
+const vector<string> &pathExecutables()
+{
+    static const vector<string> none;
+    // keep the snapshot we hand out alive until the next call
+    static shared_ptr<const PathIndex> held;
+    lock_guard<mutex> lk(pathIndexState.mtx);
+    held = pathIndexState.current;
+    return held ? held->names : none;
+}
@@ -0,0 +1,114 @@
+#include<iostream>
+#include<iostream>
+#include <sstream>
+#include <fstream>
+#include <fcntl.h>
+#include<cctype>
+#include<sys/types.h>
+#include<sys/wait.h>
+#include<sys/poll.h>
+#include <cstdio>
+#include <err.h>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <bits/stdc++.h>
+#include <unistd.h>
+#include <cctype>
+#include <sys/stat.h>
+#include <limits.h>
+#include <spawn.h>
+using namespace std;
+
+extern char **environ;
+
+// Everything needed to start one child process.
+struct SpawnSpec
+{
+    vector<string> argv;           // argv[0] is looked up in PATH
+    string cwd;                    // working directory, "" = inherit
+    vector<pair<int, int>> dups;   // dup2(first, second) in the child, in order
+    vector<string> env;            // "NAME=value" overrides, "NAME" unsets
+    string openTty;                // open this tty as stdin/out/err in a new session
+};
+
+// Start a child with posix_spawn. glibc implements it with
+// clone(CLONE_VM | CLONE_VFORK), so unlike fork() the cost does not grow with
+// our address space (scrollback, fonts, threads). In the child the dups run
+// first, then every descriptor above stderr is closed. Returns the pid, or
+// -1 with errno set.
+static pid_t spawnProcess(const SpawnSpec &spec)
+{
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawnattr_init(&attr);
+
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    sigset_t none, defaults;
+    sigemptyset(&none);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGCHLD);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    if (!spec.openTty.empty())
+    {
+        // a session leader opening a tty makes it the controlling terminal
+        flags |= POSIX_SPAWN_SETSID;
+        posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, spec.openTty.c_str(), O_RDWR, 0);
+        posix_spawn_file_actions_adddup2(&fa, STDIN_FILENO, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&fa, STDIN_FILENO, STDERR_FILENO);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    for (auto &d : spec.dups)
+        posix_spawn_file_actions_adddup2(&fa, d.first, d.second);
+    posix_spawn_file_actions_addclosefrom_np(&fa, STDERR_FILENO + 1);
+    if (!spec.cwd.empty())
+        posix_spawn_file_actions_addchdir_np(&fa, spec.cwd.c_str());
+
+    vector<char *> argv;
+    for (auto &a : spec.argv)
+        argv.push_back(const_cast<char *>(a.c_str()));
+    argv.push_back(nullptr);
+
+    // environment: ours with the requested overrides applied
+    vector<string> envStore;
+    vector<char *> envp;
+    if (!spec.env.empty())
+    {
+        for (char **e = environ; *e; ++e)
+        {
+            string kv = *e;
+            string name = kv.substr(0, kv.find('='));
+            bool overridden = false;
+            for (auto &o : spec.env)
+                if (o.substr(0, o.find('=')) == name)
+                    overridden = true;
+            if (!overridden)
+                envStore.push_back(kv);
+        }
+        for (auto &o : spec.env)
+            if (o.find('=') != string::npos)
+                envStore.push_back(o);
+        for (auto &kv : envStore)
+            envp.push_back(const_cast<char *>(kv.c_str()));
+        envp.push_back(nullptr);
+    }
+
+    pid_t pid = -1;
+    int rc = posix_spawnp(&pid, argv[0], &fa, &attr, argv.data(),
+                          spec.env.empty() ? environ : envp.data());
+
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0)
+    {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
@@ -25,6 +25,8 @@
 #include <limits.h>
 #include <thread>
 #include <atomic>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 using namespace std;
 
@@ -33,19 +35,13 @@ using namespace std;
 #include "execute.cpp"
 
 
-extern "C" void notify_sigint_from_ui();
-extern void multiWatchThreaded_using_pipes(const std::vector<std::string> &cmds, int tab_index);
-extern std::atomic<bool> mw_stop_requested;
-extern std::atomic<bool> mw_finished;
-extern std::atomic<bool> cmd_running;
-
 // Ensure these externs match drawscreen.cpp
 extern Display *dpy;
 extern Window root;
 extern int scr;
 extern int active_tab;
 extern std::vector<TabState> tabs;
-extern std::vector<std::string> inputs;
+extern std::vector<std::string_view> inputs;
 
 
 static Window create_window(int x, int y, int w, int h, int border)
@@ -54,6 +50,7 @@ static Window create_window(int x, int y, int w, int h, int border)
     Colormap cmap = DefaultColormap(dpy, scr);
     XColor bg;
     XAllocNamedColor(dpy, cmap, "#1e1e1e", &bg, &bg); // VSCode-like dark
+    bg_pixel = bg.pixel;
     xwa.background_pixel = bg.pixel;
     xwa.border_pixel = WhitePixel(dpy, scr);
     xwa.event_mask = ExposureMask | KeyPressMask | ButtonPressMask | StructureNotifyMask | PointerMotionMask;
@@ -61,6 +58,150 @@ static Window create_window(int x, int y, int w, int h, int border)
     return win;
 }
 
+static const int BLINK_MS = 500;
+static const int BLINK_IDLE_MS = 15000; // stop blinking (cursor solid) after this long without input
+
+// (re)start or stop (ms = 0) the periodic blink timer
+static void arm_blink(int fd, int ms)
+{
+    struct itimerspec its{};
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (long)(ms % 1000) * 1000000L;
+    its.it_interval = its.it_value;
+    timerfd_settime(fd, 0, &its, nullptr);
+}
+
+// Ctrl+R: rewrite the search line from T.input and show the best history
+// match on the line above it; called after every edit of the search term.
+static void refreshSearch(TabState &T)
+{
+    pullHistory(inputs);
+    size_t keep = T.screenBuffer.size() - (T.searchPreview ? 2 : 1);
+    T.screenBuffer.resize(keep);
+    invalidateWrap(T, keep);
+    HistoryHit hit = findInHistory(T.input, inputs);
+    T.searchPreview = hit.id >= 0;
+    if (T.searchPreview)
+        T.screenBuffer.push_back(string(hit.fuzzy ? "  fuzzy: " : "  match: ") + string(inputs[hit.id]));
+    T.screenBuffer.push_back("Enter search term:" + T.input);
+}
+
+// drop the preview line before the search result is shown
+static void endSearchPreview(TabState &T)
+{
+    if (!T.searchPreview)
+        return;
+    T.screenBuffer.erase(T.screenBuffer.end() - 2);
+    invalidateWrap(T, T.screenBuffer.size() - 1);
+    T.searchPreview = false;
+}
+
+// clipboard text goes into the input; lines after the first get their own
+// screen lines
+static void pasteText(TabState &T, const string &clipText)
+{
+    istringstream ss(clipText);
+    string line;
+    bool first = true;
+
+    while (getline(ss, line))
+    {
+        if (first)
+        {
+            if (!T.screenBuffer.empty())
+            {
+                T.screenBuffer.back() += line;
+                // no longer the live last line once more are pushed
+                invalidateWrap(T, T.screenBuffer.size() - 1);
+            }
+            T.input += line;
+            first = false;
+        }
+        else
+        {
+            T.screenBuffer.push_back(line);
+            T.input += '\n';
+            T.input += line;
+        }
+    }
+    T.currCursorPos = (int)T.input.size();
+}
+
+// options line above "Choose from above options:"; a huge list is cut
+// short so the line stays drawable (any number can still be chosen)
+static string formatRecs(const vector<string> &recs, bool scanning)
+{
+    static const size_t SHOWN_MAX = 200;
+    string line;
+    for (size_t i = 0; i < recs.size() && i < SHOWN_MAX; i++)
+        line += to_string(i + 1) + ". " + recs[i] + "  ";
+    if (recs.size() > SHOWN_MAX)
+        line += "(" + to_string(recs.size() - SHOWN_MAX) + " more)  ";
+    if (scanning)
+        line += "scanning...";
+    return line;
+}
+
+// act on T.recs: complete inline as far as they agree, else list them.
+// `listed`: the options lines are already up (a scan that ran async).
+static void showCompletions(TabState &T, bool listed)
+{
+    string common = T.recs.empty() ? T.query : T.recs.size() == 1 ? T.recs[0] : commonPrefix(T.recs);
+    if (T.recs.size() <= 1 || common.size() > T.query.size())
+    {
+        if (listed)
+        {
+            T.screenBuffer.resize(T.screenBuffer.size() - 2);
+            invalidateWrap(T, T.screenBuffer.size());
+            T.input = T.forRec;
+        }
+        string more = common.substr(T.query.size());
+        T.input += more;
+        if (!T.screenBuffer.empty())
+            T.screenBuffer.back() += more;
+        T.inRec = false;
+        T.currCursorPos = (int)T.input.size();
+        return;
+    }
+    if (listed)
+    {
+        T.screenBuffer[T.screenBuffer.size() - 2] = formatRecs(T.recs, false);
+        invalidateWrap(T, T.screenBuffer.size() - 2);
+        return;
+    }
+    T.screenBuffer.push_back(formatRecs(T.recs, false));
+    T.screenBuffer.push_back("Choose from above options:");
+    T.input.clear();
+    T.currCursorPos = 0;
+}
+
+// worker published more matches: show them, or finish when the scan is done
+static bool pollCompletion(TabState &T)
+{
+    if (!T.completion || !T.completion->updated.exchange(false))
+        return false;
+    if (!finishScan(*T.completion, 0, T.recs))
+    {
+        T.recs = scanMatches(*T.completion);
+        T.screenBuffer[T.screenBuffer.size() - 2] = formatRecs(T.recs, true);
+        invalidateWrap(T, T.screenBuffer.size() - 2);
+        return true;
+    }
+    T.completion.reset();
+    showCompletions(T, true);
+    return true;
+}
+
+// a key was pressed while the scan runs: stop it, keep what it found
+static void cancelCompletion(TabState &T)
+{
+    T.completion->cancelled = true;
+    T.recs = scanMatches(*T.completion);
+    T.completion.reset();
+    T.screenBuffer[T.screenBuffer.size() - 2] = formatRecs(T.recs, false);
+    invalidateWrap(T, T.screenBuffer.size() - 2);
+}
+
 void run()
 {
     dpy = XOpenDisplay(NULL);
@@ -69,17 +210,22 @@ void run()
         errx(1, "Cant open display");
     }
     inputs = loadInputs();
+    refreshPathIndex();
 
     scr = DefaultScreen(dpy);
     root = RootWindow(dpy, scr);
 
     Window win = create_window(POSX, POSY, WIDTH, HEIGHT, BORDER);
     XStoreName(dpy, win, "swagnik@myterm");
+    resize_backbuffer(win, WIDTH, HEIGHT);
 
     // font + gc
     XFontStruct *font = XLoadQueryFont(dpy, "-misc-fixed-bold-r-normal--20-200-75-75-c-100-iso8859-1");
     if (!font)
         font = XLoadQueryFont(dpy, "fixed");
+    loadGlyphAdvances(font);
+    win_state.lineHeight = max(1, font->ascent + font->descent);
+    set_geometry(WIDTH, HEIGHT);
     GC gc = XCreateGC(dpy, win, 0, nullptr);
     XSetFont(dpy, gc, font->fid);
     XSetForeground(dpy, gc, WhitePixel(dpy, scr));
@@ -102,6 +248,21 @@ void run()
     // initial tab
     add_tab("/");
 
+    // The loop sleeps in poll() until the X connection, a worker (through
+    // ui_wake_fd) or the blink timer has something for it.
+    ui_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int blink_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ui_wake_fd < 0 || blink_fd < 0)
+        err(1, "cannot create event loop descriptors");
+    arm_blink(blink_fd, BLINK_MS);
+    bool blinking = true;
+    auto lastInput = chrono::steady_clock::now();
+
+    // fixed slots first, then the capture pipes of running commands
+    enum { FD_X, FD_WAKE, FD_BLINK, FD_FIXED };
+    vector<struct pollfd> loop_fds;
+    vector<int> fd_tab; // tab index of each job slot
+
     // main event loop
     while (true)
     {
@@ -111,6 +272,16 @@ void run()
             XEvent event;
             XNextEvent(dpy, &event);
 
+            // input shows a solid cursor and restarts the blink cycle
+            if (event.type == KeyPress || event.type == ButtonPress)
+            {
+                lastInput = chrono::steady_clock::now();
+                if (active_tab >= 0 && active_tab < (int)tabs.size())
+                    tabs[active_tab].showCursor = true;
+                arm_blink(blink_fd, BLINK_MS);
+                blinking = true;
+            }
+
             // Prepare wide-char translation variables
             wchar_t wbuf[32];
             KeySym keysym = 0;
@@ -131,30 +302,28 @@ void run()
             {
             case Expose:
             {
-                XWindowAttributes wa;
-                XGetWindowAttributes(dpy, win, &wa);
-                draw_navbar(win, gc, wa.width);
-                draw_tabs(win, gc, font);
-                if (active_tab >= 0 && active_tab < (int)tabs.size())
-                    drawScreen(win, gc, font, tabs[active_tab]);
+                // the back buffer already holds the frame: just copy the exposed part
+                if (backbuf_ready)
+                    present(win, gc, event.xexpose.x, event.xexpose.y,
+                            event.xexpose.width, event.xexpose.height);
+                else if (event.xexpose.count == 0)
+                    draw_frame(win, gc, font);
                 break;
             }
 
             case ConfigureNotify:
             {
-                XWindowAttributes wa;
-                XGetWindowAttributes(dpy, win, &wa);
-                draw_navbar(win, gc, wa.width);
-                draw_tabs(win, gc, font);
-                if (active_tab >= 0 && active_tab < (int)tabs.size())
-                    drawScreen(win, gc, font, tabs[active_tab]);
+                // moves need no repaint; only a new size does
+                if (event.xconfigure.width == win_state.width && event.xconfigure.height == win_state.height && backbuf_ready)
+                    break;
+                set_geometry(event.xconfigure.width, event.xconfigure.height);
+                resize_backbuffer(win, win_state.width, win_state.height);
+                draw_frame(win, gc, font);
                 break;
             }
 
             case ButtonPress:
             {
-                XWindowAttributes wa;
-                XGetWindowAttributes(dpy, win, &wa);
                 auto tpos = draw_tabs(win, gc, font);
 
                 int tab_index = -1;
@@ -165,22 +334,18 @@ void run()
                 case -2: // "+" clicked
                 {
                     add_tab("/");
-                    draw_navbar(win, gc, wa.width);
-                    draw_tabs(win, gc, font);
-                    drawScreen(win, gc, font, tabs[active_tab]);
+                    draw_frame(win, gc, font);
                     break;
                 }
                 case -3: // "×" close clicked
                 {
                     if (tab_index >= 0 && tab_index < (int)tabs.size())
                     {
+                        stopWatch(tabs[tab_index]);
                         tabs.erase(tabs.begin() + tab_index);
                         if (active_tab >= (int)tabs.size())
                             active_tab = (int)tabs.size() - 1;
-                        draw_navbar(win, gc, wa.width);
-                        draw_tabs(win, gc, font);
-                        if (!tabs.empty())
-                            drawScreen(win, gc, font, tabs[active_tab]);
+                        draw_frame(win, gc, font);
                     }
                     break;
                 }
@@ -189,9 +354,7 @@ void run()
                     if (hit >= 0 && hit < (int)tabs.size())
                     {
                         active_tab = hit;
-                        draw_navbar(win, gc, wa.width);
-                        draw_tabs(win, gc, font);
-                        drawScreen(win, gc, font, tabs[active_tab]);
+                        draw_frame(win, gc, font);
                         break;
                     }
 
@@ -200,8 +363,7 @@ void run()
                     {
                         TabState &T = tabs[active_tab];
 
-                        int lineHeight = font->ascent + font->descent;
-                        int visibleRows = max(1, (wa.height - (NAVBAR_H + 30)) / lineHeight);
+                        int visibleRows = win_state.visibleRows;
 
                         if (event.xbutton.button == Button4)
                         { // wheel up
@@ -270,21 +432,32 @@ void run()
                     break;
 
                 TabState &T = tabs[active_tab];
+                if (T.completion && !IsModifierKey(keysym))
+                    cancelCompletion(T);
 
-                XWindowAttributes wa;
-                XGetWindowAttributes(dpy, win, &wa);
-                int lineHeight = font->ascent + font->descent;
-                int visibleRows = max(1, (wa.height - (NAVBAR_H + 30)) / lineHeight);
+                int visibleRows = win_state.visibleRows;
 
                 bool isCtrl = (event.xkey.state & ControlMask);
                 bool isShift = (event.xkey.state & ShiftMask);
 
+                // a command is still running here: only Ctrl+C, scrolling and
+                // tab switching/closing apply until it finishes
+                if (T.job || T.watch)
+                {
+                    bool allowed = keysym == XK_Page_Up || keysym == XK_Page_Down || keysym == XK_Escape ||
+                                   (isCtrl && (keysym == XK_Home || keysym == XK_End || keysym == XK_Tab ||
+                                               keysym == XK_ISO_Left_Tab || keysym == XK_c || keysym == XK_C));
+                    if (!allowed)
+                        break;
+                }
+
                 auto rebuildScreenBuffer = [&]()
                 {
                     while (!T.screenBuffer.empty() && T.screenBuffer.back().rfind("swagnik@myterm:", 0) != 0)
                         T.screenBuffer.pop_back();
                     if (!T.screenBuffer.empty())
                         T.screenBuffer.pop_back();
+                    invalidateWrap(T, T.screenBuffer.size());
 
                     string sdisp = formatPWD(T.cwd);
                     string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
@@ -321,8 +494,7 @@ void run()
                     {
                         T.input.insert(T.input.begin() + T.currCursorPos, (char)keysym);
                         T.currCursorPos++;
-                        if (!T.screenBuffer.empty())
-                            T.screenBuffer.back() += (char)keysym;
+                        refreshSearch(T);
                         drawScreen(win, gc, font, T);
                         break;
                     }
@@ -332,15 +504,15 @@ void run()
                         {
                             T.input.erase(T.input.begin() + T.currCursorPos - 1);
                             T.currCursorPos--;
-                            if (!T.screenBuffer.empty())
-                                T.screenBuffer.back().pop_back();
+                            refreshSearch(T);
                             drawScreen(win, gc, font, T);
                         }
                         break;
                     }
                     if (keysym == XK_Return || keysym == XK_KP_Enter)
                     {
-                        string search_res = searchHistory(T.input);
+                        endSearchPreview(T);
+                        string search_res = searchHistory(T.input, inputs);
                         T.input.clear();
                         string sdisp = formatPWD(T.cwd);
                         string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
@@ -374,13 +546,11 @@ void run()
                     // soft-exit: close current tab if >1, else exit
                     if (tabs.size() > 1)
                     {
+                        stopWatch(T);
                         tabs.erase(tabs.begin() + active_tab);
                         if (active_tab >= (int)tabs.size())
                             active_tab = (int)tabs.size() - 1;
-                        draw_navbar(win, gc, wa.width);
-                        auto tpos = draw_tabs(win, gc, font);
-                        if (!tabs.empty())
-                            drawScreen(win, gc, font, tabs[active_tab]);
+                        draw_frame(win, gc, font);
                     }
                     else
                     {
@@ -403,13 +573,17 @@ void run()
                     }
                     else if (!inputs.empty())
                     {
+                        // entries other windows added since; take them if not mid-browse
+                        size_t before = inputs.size();
+                        if (pullHistory(inputs) && T.inpIdx >= (int)before)
+                            T.inpIdx = (int)inputs.size();
                         T.isMultLine = false;
                         if (T.inpIdx > 0)
                             T.inpIdx--;
                         else
                             T.inpIdx = 0;
 
-                        T.input = inputs[T.inpIdx];
+                        T.input = string(inputs[T.inpIdx]);
                         for (char c : T.input)
                             if (c == '"')
                                 T.isMultLine = !T.isMultLine;
@@ -432,7 +606,7 @@ void run()
                         if (T.inpIdx < (int)inputs.size() - 1)
                         {
                             T.inpIdx++;
-                            T.input = inputs[T.inpIdx];
+                            T.input = string(inputs[T.inpIdx]);
                         }
                         else
                         {
@@ -584,10 +758,12 @@ void run()
                     }
                     else if (event.xkey.state & ControlMask)
                     {
+                        pullHistory(inputs);
                         T.screenBuffer.push_back("Enter search term:");
                         T.input.clear();
                         T.currCursorPos = 0;
                         T.isSearching = true;
+                        T.searchPreview = false;
                         drawScreen(win, gc, font, T);
                     }
                     else
@@ -607,9 +783,7 @@ void run()
                         if (!tabs.empty())
                         {
                             active_tab = (active_tab + 1) % tabs.size();
-                            draw_navbar(win, gc, wa.width);
-                            draw_tabs(win, gc, font);
-                            drawScreen(win, gc, font, tabs[active_tab]);
+                            draw_frame(win, gc, font);
                         }
                         break;
                     }
@@ -619,40 +793,41 @@ void run()
                         if (!T.input.empty())
                         {
                             T.inRec = true;
-                            T.query = getQuery(T.input);
-                            if (T.query == T.input && T.query.rfind("./", 0) == 0)
-                                T.query = T.query.substr(2);
+                            string token = getQuery(T.input);
                             T.forRec = T.input;
 
-                            auto outputs = execCommandInDir("ls", T.cwd);
-                            vector<string> candidates;
-                            for (auto &l : outputs)
-                                if (!l.empty() && l.rfind("ERROR:", 0) != 0)
-                                    candidates.push_back(l);
-
-                            T.recs = getRecomm(T.query, candidates);
-                            if (T.recs.empty())
+                            // the first word names a command: complete it from $PATH
+                            bool firstWord = T.input.find_first_not_of(' ') == T.input.size() - token.size() &&
+                                             token.find('/') == string::npos;
+                            // otherwise complete the last path component, in the directory
+                            // the rest of the token names
+                            string dir;
+                            splitCompletionPath(token, T.cwd, dir, T.query);
+                            if (firstWord)
                             {
-                                T.inRec = false;
-                            }
-                            else if (T.recs.size() == 1)
-                            {
-                                T.input += T.recs[0].substr(T.query.size());
-                                if (!T.screenBuffer.empty())
-                                    T.screenBuffer.back() += T.recs[0].substr(T.query.size());
-                                T.inRec = false;
-                                T.currCursorPos = (int)T.input.size();
+                                refreshPathIndex();
+                                T.recs = getRecomm(T.query, pathExecutables());
                             }
+                            else if (const vector<string> *cached = cachedDirectory(dir))
+                                T.recs = getRecomm(T.query, *cached);
                             else
                             {
-                                for (size_t i = 0; i < T.recs.size(); i++)
-                                    T.showRec += to_string(i + 1) + ". " + T.recs[i] + "  ";
-                                T.screenBuffer.push_back(T.showRec);
-                                T.screenBuffer.push_back("Choose from above options:");
-                                T.input.clear();
-                                T.currCursorPos = 0;
-                                T.showRec.clear();
+                                // not cached: read it on a worker, and only if that takes
+                                // noticeably long show its matches as they come in
+                                auto scan = startScan(dir, T.query, wake_ui);
+                                if (!finishScan(*scan, 20, T.recs))
+                                {
+                                    T.completion = scan;
+                                    T.recs = scanMatches(*scan);
+                                    T.screenBuffer.push_back(formatRecs(T.recs, true));
+                                    T.screenBuffer.push_back("Choose from above options:");
+                                    T.input.clear();
+                                    T.currCursorPos = 0;
+                                    drawScreen(win, gc, font, T);
+                                    break;
+                                }
                             }
+                            showCompletions(T, false);
                             drawScreen(win, gc, font, T);
                         }
                         break;
@@ -667,9 +842,7 @@ void run()
                         if (!tabs.empty())
                         {
                             active_tab = (active_tab - 1 + tabs.size()) % tabs.size();
-                            draw_navbar(win, gc, wa.width);
-                            draw_tabs(win, gc, font);
-                            drawScreen(win, gc, font, tabs[active_tab]);
+                            draw_frame(win, gc, font);
                         }
                     }
                     break;
@@ -678,23 +851,23 @@ void run()
                 case XK_c:
                 case XK_C:
                 {
+                    if ((event.xkey.state & ControlMask) && T.job)
+                    {
+                        // the prompt returns once the interrupted command exits
+                        interruptJob(T);
+                        T.screenBuffer.push_back("^C");
+                        drawScreen(win, gc, font, T);
+                        break;
+                    }
                     if (event.xkey.state & ControlMask)
                     {
-                        // Request stop from execute.cpp (async-safe)
-                        notify_sigint_from_ui();
-
-                        
-                        for (int i = 0; i < 10; ++i)
-                        {
-                            if (mw_finished.load())
-                                break;
-                            this_thread::sleep_for(chrono::milliseconds(50));
-                        }
-
-                        // Reset stop flags so the next command can run normally.
-                        mw_stop_requested.store(false);
-                        mw_finished.store(false);
-                        cmd_running.store(false);
+                        // stop a multiWatch, or just drop the typed line
+                        if (T.watch)
+                            stopWatch(T);
+                        // leave Ctrl+R search; its lines stay as scrollback, so
+                        // nothing may pop them once the new prompt is below
+                        T.isSearching = false;
+                        T.searchPreview = false;
 
                         // Append ^C and prompt to screenBuffer and redraw
                         TabState &T2 = tabs[active_tab];
@@ -726,7 +899,8 @@ void run()
                                 int recIdx = min(getRecIdx(T.input), (int)T.recs.size()) - 1;
                                 if (recIdx < 0)
                                     recIdx = 0;
-                                string rec = T.recs[recIdx];
+                                // a scan cancelled before it found anything leaves no options
+                                string rec = T.recs.empty() ? T.query : T.recs[recIdx];
                                 T.input = T.forRec + rec.substr(T.query.size());
 
                                 string sdisp = formatPWD(T.cwd);
@@ -739,17 +913,20 @@ void run()
                                     T.screenBuffer.pop_back();
                                 if (!T.screenBuffer.empty())
                                     T.screenBuffer.pop_back();
+                                invalidateWrap(T, T.screenBuffer.size());
 
                                 T.screenBuffer.push_back(prompt + T.input);
                                 T.currCursorPos = (int)T.input.size();
                                 T.inRec = false;
+                                drawScreen(win, gc, font, T);
                                 break;
                             }
 
                             // Search mode: use history search
                             if (T.isSearching)
                             {
-                                string search_res = searchHistory(T.input);
+                                endSearchPreview(T);
+                                string search_res = searchHistory(T.input, inputs);
                                 T.input.clear();
                                 string sdisp = formatPWD(T.cwd);
                                 string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
@@ -787,12 +964,12 @@ void run()
                             else
                             {
                                 // Normal command execution flow
+                                pullHistory(inputs);
                                 if (!T.input.empty())
                                 {
                                     if (inputs.empty() || inputs.back() != T.input)
                                     {
-                                        storeInput(T.input);
-                                        inputs.push_back(T.input);
+                                        inputs.push_back(storeInput(T.input));
                                     }
                                 }
                                 T.count = 0;
@@ -809,27 +986,42 @@ void run()
                                 };
                                 string trimmed = trimLocal(T.input);
 
-                                // Built-in history command displays stored history file.
-                                if (trimmed == "history")
+                                // Built-in history command displays the most recent 1000 entries;
+                                // `history -w [file]` exports them as text (default ./history.txt).
+                                if (trimmed == "history" || trimmed.rfind("history -w", 0) == 0)
                                 {
-                                    ifstream in(FILENAME);
-                                    if (!in)
+                                    if (trimmed == "history")
                                     {
-                                        cerr << "Error: cannot open file\n";
+                                        size_t total = inputs.size();
+                                        for (size_t i = total > 1000 ? total - 1000 : 0; i < total; ++i)
+                                            T.screenBuffer.push_back("  " + to_string(historyNumber(i)) + "  " + string(inputs[i]));
                                     }
                                     else
                                     {
-                                        string line;
-                                        while (getline(in, line))
-                                            T.screenBuffer.push_back(line);
-                                        in.close();
+                                        string path = trimLocal(trimmed.substr(10));
+                                        if (path.empty())
+                                            path = FILENAME;
+                                        else if (path[0] != '/')
+                                            path = T.cwd + "/" + path;
+                                        if (!exportHistoryText(path, inputs))
+                                            T.screenBuffer.push_back("ERROR: history: cannot write " + path);
                                     }
+                                    string sdisp = formatPWD(T.cwd);
+                                    string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
+                                    T.screenBuffer.push_back(prompt);
+                                    T.input.clear();
+                                    T.currCursorPos = 0;
+                                    if (!T.userScrolled)
+                                        scroll_to_bottom(T);
+                                    drawScreen(win, gc, font, T);
+                                    break;
                                 }
 
                                 // Built-in clear command
                                 if (trimmed == "clear")
                                 {
                                     T.screenBuffer.clear();
+                                    invalidateWrap(T);
                                     string sdisp = formatPWD(T.cwd);
                                     string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
                                     T.screenBuffer.push_back(prompt);
@@ -846,20 +1038,14 @@ void run()
                                
                                 if (trimmed.rfind("multiWatch", 0) == 0)
                                 {
-                                    size_t start = T.input.find('[');
-                                    size_t end = T.input.find(']');
-                                    if (start != string::npos && end != string::npos && end > start)
+                                    size_t start = trimmed.find('[');
+                                    size_t end = trimmed.rfind(']');
+                                    vector<string> onPaths;
+                                    if (start != string::npos && end != string::npos && end > start &&
+                                        parseWatchPaths(trimmed.substr(10, start - 10), onPaths))
                                     {
-                                        string inside = T.input.substr(start + 1, end - start - 1);
-                                        vector<string> cmds;
-                                        regex r("\"([^\"]+)\"");
-                                        smatch m;
-                                        string::const_iterator s(inside.cbegin());
-                                        while (regex_search(s, inside.cend(), m, r))
-                                        {
-                                            cmds.push_back(m[1]);
-                                            s = m.suffix().first;
-                                        }
+                                        string inside = trimmed.substr(start + 1, end - start - 1);
+                                        vector<WatchCommand> cmds = parseWatchCommands(inside);
 
                                         if (cmds.empty())
                                         {
@@ -867,60 +1053,68 @@ void run()
                                         }
                                         else
                                         {
-                                            //  Copy old screen buffer safely
-                                            vector<string> oldBuffer;
-                                            oldBuffer.insert(oldBuffer.end(), T.screenBuffer.begin(), T.screenBuffer.end());
-
-                                            // Clear screen for watch mode
-                                            T.screenBuffer.clear();
-                                            T.screenBuffer.push_back("multiWatch — starting...");
-
-                                            // Mark multiwatch active
-                                            mw_stop_requested.store(false);
-                                            mw_finished.store(false);
-
-                                            // Pass oldBuffer to thread so it can restore later
-                                            thread([cmds, tab_index = active_tab, oldBuffer]()
-                                                   { multiWatchThreaded_using_pipes(cmds, tab_index, oldBuffer); })
-                                                .detach();
+                                            string err = startWatch(T, cmds, onPaths);
+                                            if (!err.empty())
+                                                T.screenBuffer.push_back(err);
                                         }
                                     }
                                     else
                                     {
-                                        T.screenBuffer.push_back("Usage: multiWatch [\"cmd1\", \"cmd2\", ...]");
+                                        T.screenBuffer.push_back("Usage: multiWatch [--on path ...] [\"cmd1\", \"cmd2\" @5s, ...]");
                                     }
 
                                     // Clear input for next command
                                     T.input.clear();
                                     T.currCursorPos = 0;
+                                    drawScreen(win, gc, font, T);
+                                    break;
+                                }
+
+                                // Built-in pty on/off: keep one shell per tab alive between commands
+                                if (trimmed == "pty on" || trimmed == "pty off")
+                                {
+                                    if (trimmed == "pty off")
+                                        T.shell.reset();
+                                    else if (!T.shell)
+                                    {
+                                        T.shell = startShell(T.cwd);
+                                        if (!T.shell)
+                                            T.screenBuffer.push_back("ERROR: pty: cannot start shell");
+                                    }
+                                    string sdisp = formatPWD(T.cwd);
+                                    string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
+                                    T.screenBuffer.push_back(prompt);
+                                    T.input.clear();
+                                    T.currCursorPos = 0;
+                                    if (!T.userScrolled)
+                                        scroll_to_bottom(T);
+                                    drawScreen(win, gc, font, T);
                                     break;
                                 }
 
-                                // execute in tab cwd
-                                vector<string> outputs = execCommandInDir(T.input, T.cwd);
+                                // execute in tab cwd; a command that keeps running streams
+                                // its output from the event loop below
+                                vector<string> outputs;
+                                bool started = T.shell ? startShellCommand(T.input, T, outputs)
+                                                       : startJob(T.input, T, outputs);
                                 T.input.clear();
                                 T.currCursorPos = 0;
 
-                                bool isMultiWatch = (T.input.find("multiWatch") != string::npos);
-
                                 // push command output lines
                                 for (const auto &line : outputs)
                                     T.screenBuffer.push_back(line);
 
-                                // show prompt if not multiWatch
-                                if (!isMultiWatch)
+                                // prompt comes back when the command is done
+                                if (!started)
                                 {
                                     string sdisp = formatPWD(T.cwd);
                                     string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
                                     T.screenBuffer.push_back(prompt);
                                 }
 
-                                int totalDisplayLines = drawScreen(win, gc, font, T);
                                 if (!T.userScrolled)
-                                {
-                                    T.scrollOffset = max(0, totalDisplayLines - visibleRows);
-                                    drawScreen(win, gc, font, T);
-                                }
+                                    scroll_to_bottom(T);
+                                drawScreen(win, gc, font, T);
                                 break;
                             } // end else not multiline
                         } // end ENTER handling
@@ -953,8 +1147,7 @@ void run()
                         {
                             T.input.insert(T.input.begin() + T.currCursorPos, ch);
                             T.currCursorPos++;
-                            if (!T.screenBuffer.empty())
-                                T.screenBuffer.back() += ch;
+                            refreshSearch(T);
                             drawScreen(win, gc, font, T);
                             break;
                         }
@@ -974,7 +1167,9 @@ void run()
                             {
                                 T.input.erase(T.input.begin() + T.currCursorPos - 1);
                                 T.currCursorPos--;
-                                if (!T.screenBuffer.empty() && !T.screenBuffer.back().empty())
+                                if (T.isSearching)
+                                    refreshSearch(T);
+                                else if (!T.screenBuffer.empty() && !T.screenBuffer.back().empty())
                                     T.screenBuffer.back().pop_back();
                                 drawScreen(win, gc, font, T);
                                 break;
@@ -1005,6 +1200,8 @@ void run()
                 if (!(active_tab >= 0 && active_tab < (int)tabs.size()))
                     break;
                 TabState &T = tabs[active_tab];
+                if (T.job)
+                    break;
 
                 if (event.xselection.selection == XInternAtom(dpy, "CLIPBOARD", False))
                 {
@@ -1023,27 +1220,7 @@ void run()
                         std::string clipText((char *)data, nitems);
                         XFree(data);
 
-                        std::istringstream ss(clipText);
-                        std::string line;
-                        bool first = true;
-
-                        while (std::getline(ss, line))
-                        {
-                            if (first)
-                            {
-                                if (!T.screenBuffer.empty())
-                                    T.screenBuffer.back() += line;
-                                T.input += line;
-                                first = false;
-                            }
-                            else
-                            {
-                                T.screenBuffer.push_back(line);
-                                T.input += '\n';
-                                T.input += line;
-                            }
-                        }
-                        T.currCursorPos = (int)T.input.size();
+                        pasteText(T, clipText);
                         drawScreen(win, gc, font, T);
                     }
                 }
@@ -1058,35 +1235,108 @@ void run()
             } // end switch(event.type)
         } // end XPending loop
 
-        // multiWatch finished handling 
-        if (mw_finished.load())
+        // blink active tab cursor only
+        if (loop_fds.size() > FD_BLINK && (loop_fds[FD_BLINK].revents & POLLIN))
         {
-            // execute.cpp is expected to have restored the tab's screenBuffer.
+            uint64_t expirations;
+            while (read(blink_fd, &expirations, sizeof(expirations)) > 0)
+                ;
             if (active_tab >= 0 && active_tab < (int)tabs.size())
             {
-                drawScreen(win, gc, font, tabs[active_tab]);
+                TabState &T = tabs[active_tab];
+                auto idle = chrono::steady_clock::now() - lastInput;
+                if (chrono::duration_cast<chrono::milliseconds>(idle).count() > BLINK_IDLE_MS)
+                {
+                    // idle: leave the cursor on and stop waking up
+                    T.showCursor = true;
+                    arm_blink(blink_fd, 0);
+                    blinking = false;
+                }
+                else
+                    T.showCursor = !T.showCursor;
+                blinkCursor(win, gc, font, T);
             }
-            // reset signals so next multiWatch can be started normally
-            mw_finished.store(false);
-            mw_stop_requested.store(false);
-            cmd_running.store(false);
         }
 
-        // blink active tab cursor only
-        if (active_tab >= 0 && active_tab < (int)tabs.size())
+        // wait for the next event source
+        XFlush(dpy);
+        loop_fds.clear();
+        fd_tab.clear();
+        if (XPending(dpy) > 0)
+            continue;
+        loop_fds.push_back({ConnectionNumber(dpy), POLLIN, 0});
+        loop_fds.push_back({ui_wake_fd, POLLIN, 0});
+        loop_fds.push_back({blinking ? blink_fd : -1, POLLIN, 0});
+        bool reapByTimer = false; // a job to reap has no pidfd to wait on
+        for (size_t i = 0; i < tabs.size(); ++i)
         {
-            TabState &T = tabs[active_tab];
-            auto now = chrono::steady_clock::now();
-            if (chrono::duration_cast<chrono::milliseconds>(now - T.lastBlink).count() > 500)
+            if (!tabs[i].job)
+                continue;
+            Job &job = *tabs[i].job;
+            // pipes closed but not exited yet: wait for the exit itself
+            int exitFd = -1;
+            if (job.outFd < 0 && job.errFd < 0)
             {
-                T.showCursor = !T.showCursor;
-                T.lastBlink = now;
-                drawScreen(win, gc, font, T);
+                exitFd = jobExitFd(job);
+                if (exitFd < 0)
+                    reapByTimer = true;
             }
+            for (int fd : {job.outFd, job.errFd, exitFd})
+                if (fd >= 0)
+                {
+                    loop_fds.push_back({fd, POLLIN, 0});
+                    fd_tab.push_back((int)i);
+                }
+        }
+        if (poll(loop_fds.data(), loop_fds.size(), reapByTimer ? REAP_POLL_MS : -1) < 0 && errno != EINTR)
+            err(1, "poll");
+        if (loop_fds[FD_WAKE].revents & POLLIN)
+        {
+            uint64_t wakes;
+            read(ui_wake_fd, &wakes, sizeof(wakes));
         }
 
-        // tiny sleep
-        this_thread::sleep_for(chrono::milliseconds(20));
+        // stream command output into its tab
+        bool activeChanged = false;
+        for (size_t i = 0; i < tabs.size(); ++i)
+            if ((pollCompletion(tabs[i]) | adoptWatchSnapshot(tabs[i])) && (int)i == active_tab)
+                activeChanged = true;
+        for (size_t k = FD_FIXED; k < loop_fds.size(); ++k)
+        {
+            if (!(loop_fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            TabState &T = tabs[fd_tab[k - FD_FIXED]];
+            if (!T.job)
+                continue;
+            bool done = (loop_fds[k].fd == T.job->exitFd) ? reapJob(T) : pumpJob(T, loop_fds[k].fd);
+            if (done)
+            {
+                string sdisp = formatPWD(T.cwd);
+                string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
+                T.screenBuffer.push_back(prompt);
+            }
+            if (fd_tab[k - FD_FIXED] == active_tab)
+                activeChanged = true;
+        }
+        if (reapByTimer)
+            for (size_t i = 0; i < tabs.size(); ++i)
+            {
+                TabState &T = tabs[i];
+                if (!T.job || T.job->outFd >= 0 || T.job->errFd >= 0 || T.job->exitFd >= 0 || !reapJob(T))
+                    continue;
+                string sdisp = formatPWD(T.cwd);
+                string prompt = (sdisp == "/") ? ("swagnik@myterm:" + sdisp + "$ ") : ("swagnik@myterm:~" + sdisp + "$ ");
+                T.screenBuffer.push_back(prompt);
+                if ((int)i == active_tab)
+                    activeChanged = true;
+            }
+        if (activeChanged)
+        {
+            TabState &T = tabs[active_tab];
+            if (!T.userScrolled)
+                scroll_to_bottom(T);
+            drawScreen(win, gc, font, T);
+        }
     } // end main while
 
     // cleanup (not typically reached)
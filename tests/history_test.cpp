@@ -0,0 +1,109 @@
+// two myterm processes sharing history.bin: each must end up with the
+// entries in file order, so `history` numbers match a fresh load.
+// build and run with `make test`; runs in a scratch directory.
+#include "../helper/history.cpp"
+
+static int failures = 0;
+
+static void expect(const string &what, const vector<string> &got, const vector<string> &want)
+{
+    if (got == want)
+    {
+        printf("ok   %s\n", what.c_str());
+        return;
+    }
+    ++failures;
+    printf("FAIL %s\n", what.c_str());
+    for (auto &l : got)
+        printf("     got  [%s]\n", l.c_str());
+    for (auto &l : want)
+        printf("     want [%s]\n", l.c_str());
+}
+
+// "number entry" lines as `history` prints them
+static vector<string> numbered(const vector<string_view> &inputs)
+{
+    vector<string> out;
+    for (size_t i = 0; i < inputs.size(); ++i)
+        out.push_back(to_string(historyNumber(i)) + " " + string(inputs[i]));
+    return out;
+}
+
+// the same, read straight from the file
+static vector<string> numberedFromFile()
+{
+    ifstream in(HISTORY_BIN, ios::binary);
+    string buf((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    HistoryHeader h{};
+    vector<uint64_t> offs;
+    parseHistoryFile(buf.data(), buf.size(), h, offs);
+    vector<string> out;
+    for (size_t i = 0; i < offs.size(); ++i)
+    {
+        uint32_t len;
+        memcpy(&len, buf.data() + offs[i], sizeof(len));
+        out.push_back(to_string(h.firstNum + i) + " " + buf.substr(offs[i] + sizeof(len), len));
+    }
+    return out;
+}
+
+static void waitFor(int fd)
+{
+    char c;
+    if (read(fd, &c, 1) != 1)
+        exit(2);
+}
+
+static void notify(int fd)
+{
+    if (write(fd, "x", 1) != 1)
+        exit(2);
+}
+
+int main()
+{
+    char dir[] = "/tmp/myterm_history_XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0)
+        return 1;
+    int toChild[2], toParent[2];
+    if (pipe(toChild) != 0 || pipe(toParent) != 0)
+        return 1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // the other window: writes its entry at once
+        waitFor(toChild[0]);
+        setenv("MYTERM_HISTORY_FLUSH_MS", "0", 1);
+        vector<string_view> inputs = loadInputs();
+        inputs.push_back(storeInput("b1"));
+        closeHistory();
+        notify(toParent[1]);
+        _exit(0);
+    }
+
+    // this window: "a1" is typed first but written after "b1"
+    setenv("MYTERM_HISTORY_FLUSH_MS", "500", 1);
+    vector<string_view> inputs = loadInputs();
+    inputs.push_back(storeInput("a0"));
+    usleep(800000); // a0 is in the file
+    inputs.push_back(storeInput("a1"));
+    notify(toChild[1]);
+    waitFor(toParent[0]);
+    waitpid(pid, nullptr, 0);
+    usleep(800000); // our writer has appended a1 after b1
+    pullHistory(inputs);
+    inputs.push_back(storeInput("a2"));
+    closeHistory();
+    pullHistory(inputs);
+
+    vector<string> file = numberedFromFile();
+    expect("file order", file, {"1 a0", "2 b1", "3 a1", "4 a2"});
+    expect("numbers match the file", numbered(inputs), file);
+    HistoryHit hit = findInHistory("b1", inputs);
+    expect("search ids follow the order", {hit.id >= 0 ? string(inputs[hit.id]) : "none"}, {"b1"});
+
+    system((string("rm -rf ") + dir).c_str());
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
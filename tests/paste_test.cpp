@@ -0,0 +1,62 @@
+// pasting into the prompt line: the wrap cache must show the pasted text
+// on the prompt row and give every further line its own rows.
+// build and run with `make test`; no X display needed.
+#include "../run.cpp"
+
+static int failures = 0;
+
+static vector<string> wrappedRows(TabState &T, int width)
+{
+    updateWrapCache(T, width);
+    vector<string> rows;
+    for (auto &r : T.wrapRows)
+        rows.push_back(T.screenBuffer[r.line].substr(r.start, r.len));
+    return rows;
+}
+
+static void expect(const string &what, const vector<string> &got, const vector<string> &want)
+{
+    if (got == want)
+    {
+        printf("ok   %s\n", what.c_str());
+        return;
+    }
+    ++failures;
+    printf("FAIL %s\n", what.c_str());
+    for (auto &l : got)
+        printf("     got  [%s]\n", l.c_str());
+    for (auto &l : want)
+        printf("     want [%s]\n", l.c_str());
+}
+
+int main()
+{
+    // one cell per byte, as with a fixed font
+    for (int c = 0; c < 256; ++c)
+        glyphs.width[c] = 1;
+    glyphs.cell = 1;
+    glyphs.monospace = true;
+
+    TabState T;
+    T.screenBuffer = {"ls", "swagnik@myterm:/$ "};
+    expect("prompt before paste", wrappedRows(T, 80), {"ls", "swagnik@myterm:/$ "});
+
+    pasteText(T, "echo pasted\necho second\nthird");
+    expect("multi-line paste", wrappedRows(T, 80),
+           {"ls", "swagnik@myterm:/$ echo pasted", "echo second", "third"});
+    expect("input holds every line", {T.input}, {"echo pasted\necho second\nthird"});
+
+    pasteText(T, "more\nlast");
+    expect("second paste", wrappedRows(T, 80),
+           {"ls", "swagnik@myterm:/$ echo pasted", "echo second", "thirdmore", "last"});
+
+    TabState N;
+    N.screenBuffer = {"swagnik@myterm:/$ "};
+    wrappedRows(N, 10);
+    pasteText(N, "echo pasted\nx");
+    expect("paste that wraps", wrappedRows(N, 10),
+           {"swagnik@my", "term:/$ ec", "ho pasted", "x"});
+
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
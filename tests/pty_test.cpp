@@ -0,0 +1,73 @@
+// pty mode: commands that read stdin must get the user's input, not the
+// completion sentinel, and the shell must stay in step with the tab.
+// build and run with `make test`; needs bash, no X display.
+#include "../execute.cpp"
+
+static int failures = 0;
+
+// run `cmd` in the tab's shell, feeding `input` to it once it is started
+static vector<string> runShell(TabState &T, const string &cmd, const string &input)
+{
+    vector<string> out;
+    size_t before = T.screenBuffer.size();
+    if (!startShellCommand(cmd, T, out))
+        return out;
+    if (!input.empty())
+    {
+        // give the command time to start, as a user typing would
+        poll(nullptr, 0, 200);
+        ssize_t w = write(T.shell->masterFd, input.data(), input.size());
+        (void)w;
+    }
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (T.job && chrono::steady_clock::now() < deadline)
+    {
+        pollfd p{T.job->outFd, POLLIN, 0};
+        if (poll(&p, 1, 100) > 0)
+            pumpJob(T, p.fd);
+    }
+    if (T.job)
+        out.push_back("(still running)");
+    out.insert(out.end(), T.screenBuffer.begin() + before, T.screenBuffer.end());
+    return out;
+}
+
+static void expect(const string &what, const vector<string> &got, const vector<string> &want)
+{
+    if (got == want)
+    {
+        printf("ok   %s\n", what.c_str());
+        return;
+    }
+    ++failures;
+    printf("FAIL %s\n", what.c_str());
+    for (auto &l : got)
+        printf("     got  [%s]\n", l.c_str());
+    for (auto &l : want)
+        printf("     want [%s]\n", l.c_str());
+}
+
+int main()
+{
+    TabState T;
+    T.cwd = "/tmp";
+    T.shell = startShell(T.cwd);
+    if (!T.shell)
+    {
+        printf("FAIL cannot start shell\n");
+        return 1;
+    }
+
+    expect("echo", runShell(T, "echo before", ""), {"before"});
+    expect("cat reads its input", runShell(T, "cat", "hello\n\x04"), {"hello"});
+    expect("next command runs after cat", runShell(T, "echo after", ""), {"after"});
+    expect("read", runShell(T, "read x; echo got:$x", "abc\n"), {"got:abc"});
+    // bash ends the interrupted line itself
+    expect("cat interrupted", runShell(T, "cat", "\x03"), {""});
+    expect("shell state kept", runShell(T, "x=42; cd /; echo $x", ""), {"42"});
+    expect("cwd follows the shell", {T.cwd}, {"/"});
+    expect("status without output", runShell(T, "false", ""), {"ERROR: (process exited with code 1)"});
+
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}